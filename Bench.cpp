@@ -0,0 +1,513 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define Assert(condition) if(!(condition)) __builtin_trap();
+#define func
+
+#include "Math.hpp"
+#include "Memory.hpp"
+#include "Profiler.hpp"
+#include "Render.hpp"
+#include "TileRenderer.hpp"
+#include "Scene.hpp"
+#include "InputRecording.hpp"
+#include "ResolutionScaler.hpp"
+
+enum BenchSceneKind
+{
+	BENCH_IDLE,
+	BENCH_SPIN,
+	BENCH_TURN,
+	BENCH_REPLAY,
+	BENCH_SCENE_N
+};
+
+const char *bench_scene_names[BENCH_SCENE_N] =
+{
+	"idle",
+	"spin",
+	"turn",
+	"replay"
+};
+
+const char *bench_simd_names[] =
+{
+	"none",
+	"sse2",
+	"avx2"
+};
+
+struct BenchOptions
+{
+	int width;
+	int height;
+	int frames;
+	int warmup_frames;
+	int scene_kind;
+	int simd_level;
+	int thread_n;
+	int side_n;
+	bool depth_test;
+	bool store_cube_face_ids;
+	bool use_palette;
+	int outline_thickness;
+	char *dump_prefix;
+	char *profile_prefix;
+	char *record_prefix;
+	char *replay_path;
+	double budget_ms;
+	float min_scale;
+	float max_scale;
+};
+
+static double
+func GetSeconds()
+{
+	timespec time = {};
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	double seconds = (double)time.tv_sec + 1e-9 * (double)time.tv_nsec;
+	return seconds;
+}
+
+static int
+func CompareDoubles(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	int result = 0;
+	if(x < y) result = -1;
+	else if(x > y) result = +1;
+	return result;
+}
+
+static unsigned int
+func GetBufferChecksum(Buffer *buffer)
+{
+	unsigned int hash = 2166136261u;
+	for(int row = 0; row < buffer->height; row++)
+	{
+		unsigned int *colors = buffer->colors + row * buffer->pitch;
+		for(int col = 0; col < buffer->width; col++)
+		{
+			hash = (hash ^ colors[col]) * 16777619u;
+		}
+	}
+
+	return hash;
+}
+
+static void
+func DumpBuffer(Buffer *buffer, char *path)
+{
+	FILE *file = fopen(path, "wb");
+	if(!file)
+	{
+		fprintf(stderr, "cannot open %s\n", path);
+		return;
+	}
+
+	fprintf(file, "P6\n%d %d\n255\n", buffer->width, buffer->height);
+	for(int row = buffer->height - 1; row >= 0; row--)
+	{
+		for(int col = 0; col < buffer->width; col++)
+		{
+			unsigned int color = buffer->colors[row * buffer->pitch + col];
+			unsigned char rgb[3] = {(unsigned char)(color >> 16), (unsigned char)(color >> 8), (unsigned char)color};
+			fwrite(rgb, 1, 3, file);
+		}
+	}
+
+	fclose(file);
+}
+
+static Quat
+func GetBenchTilt()
+{
+	Quat tilt_x = GetRotationQuat(Vector3(1.0f, 0.0f, 0.0f), 0.5f);
+	Quat tilt_y = GetRotationQuat(Vector3(0.0f, 1.0f, 0.0f), -0.6f);
+	Quat tilt = tilt_x * tilt_y;
+	return tilt;
+}
+
+// Screen position of the middle cubie on the front face, the turn scene grabs the cube there.
+static V2
+func GetBenchTurnPixel(Buffer *buffer, Scene *scene)
+{
+	BigCube *big_cube = &scene->big_cube;
+	float small_side_radius = big_cube->cube_radius;
+	float side_radius = small_side_radius * (float)big_cube->side_n;
+
+	float offset = -side_radius + small_side_radius * (float)(2 * (big_cube->side_n / 2) + 1);
+	V3 face_point = Point3(offset, offset, side_radius);
+
+	V3 screen_center = 0.5f * Point3((float)buffer->width, (float)buffer->height, 0.0f);
+	V2 pixel = ProjectToScreen(screen_center + QuatRotate(big_cube->rotations, face_point));
+	return pixel;
+}
+
+static Input
+func GetScriptedInput(int scene_kind, int frame, V2 turn_pixel)
+{
+	Input input = {};
+	input.mouse_position = Point2(2.0f, 2.0f);
+
+	switch(scene_kind)
+	{
+		case BENCH_IDLE:
+		{
+			break;
+		}
+		case BENCH_SPIN:
+		{
+			input.mouse_position = input.mouse_position + Vector2(3.0f * (float)frame, 2.0f * (float)frame);
+			input.left_mouse_button_down = true;
+			break;
+		}
+		case BENCH_TURN:
+		{
+			int cycle_frame_n = 48;
+			int drag_frame_n = 40;
+
+			int cycle_frame = frame % cycle_frame_n;
+			int drag_frame = (cycle_frame < drag_frame_n) ? cycle_frame : drag_frame_n - 1;
+
+			input.mouse_position = turn_pixel + Vector2(2.0f * (float)drag_frame, 0.0f);
+			input.left_mouse_button_down = (cycle_frame < drag_frame_n);
+			break;
+		}
+		default:
+		{
+			Assert(false);
+		}
+	}
+
+	return input;
+}
+
+// The replay scene draws the frames of a recording, the first warmup frames of it are not timed.
+// With a budget the scripted scenes are drawn at the scale the resolution scaler picks, frame by frame.
+static void
+func RunBenchScene(BenchOptions *options, int scene_kind, InputRecording *replay)
+{
+	Buffer buffer = {};
+	buffer.depth_test = options->depth_test;
+	buffer.store_cube_face_ids = options->store_cube_face_ids;
+	buffer.use_palette = options->use_palette;
+	ResizeBuffer(&buffer, options->width, options->height);
+	SetBufferOutline(&buffer, options->outline_thickness, 0x000000);
+
+	int min_side = (options->width < options->height) ? options->width : options->height;
+	float side_radius = 0.25f * (float)min_side;
+
+	TileRenderer *renderer = new TileRenderer();
+	InitTileRenderer(renderer, options->thread_n);
+
+	Scene *scene = new Scene;
+	InitScene(scene, options->side_n, side_radius);
+	if(scene_kind == BENCH_REPLAY) StartInputReplay(replay, scene, &buffer);
+	else if(scene_kind != BENCH_SPIN) scene->big_cube.rotations = GetBenchTilt();
+
+	V2 turn_pixel = GetBenchTurnPixel(&buffer, scene);
+
+	InputRecording recording = {};
+	if(options->record_prefix) StartInputRecording(&recording, scene, &buffer);
+
+	bool is_scaling = (options->budget_ms > 0.0 && scene_kind != BENCH_REPLAY);
+	ResolutionScaler scaler = {};
+	InitResolutionScaler(&scaler, is_scaling ? options->budget_ms / 1000.0 : 0.0, options->min_scale, options->max_scale);
+	double scale_sum = 0.0;
+
+#if PROFILER_ENABLED
+	ResetProfiler();
+#endif
+
+	int frame_n = options->warmup_frames + options->frames;
+	double *frame_times = new double[options->frames];
+	long long drawn_face_n = 0;
+	long long culled_face_n = 0;
+	long long cleared_pixel_n = 0;
+	long long damaged_pixel_n = 0;
+	for(int frame = 0; frame < frame_n; frame++)
+	{
+		Input input = {};
+		if(scene_kind == BENCH_REPLAY) input = GetReplayInput(replay, frame, scene, &buffer);
+		else input = GetScriptedInput(scene_kind, frame, turn_pixel);
+
+		if(is_scaling)
+		{
+			scene->render_scale = scaler.scale;
+			int width = GetScaledSize(options->width, scaler.scale);
+			int height = GetScaledSize(options->height, scaler.scale);
+			if(buffer.width != width || buffer.height != height) ResizeBuffer(&buffer, width, height);
+		}
+
+		if(options->record_prefix) RecordInputFrame(&recording, &buffer, scene, input);
+
+		long long prev_cleared_pixel_n = renderer->cleared_pixel_n;
+
+		double start = GetSeconds();
+		PROFILE_BEGIN_FRAME();
+		DrawScene(&buffer, renderer, scene, input);
+		PROFILE_END_FRAME();
+		double end = GetSeconds();
+
+		if(is_scaling) UpdateResolutionScale(&scaler, end - start);
+
+		if(frame >= options->warmup_frames)
+		{
+			frame_times[frame - options->warmup_frames] = 1000.0 * (end - start);
+			drawn_face_n += renderer->list.drawn_face_n;
+			culled_face_n += renderer->list.culled_face_n;
+			cleared_pixel_n += renderer->cleared_pixel_n - prev_cleared_pixel_n;
+			for(int i = 0; i < renderer->damage_rect_n; i++) damaged_pixel_n += GetRectPixelN(renderer->damage_rects[i]);
+			scale_sum += scene->render_scale;
+		}
+	}
+
+	qsort(frame_times, options->frames, sizeof(frame_times[0]), CompareDoubles);
+
+	int p99_index = (int)ceil(0.99 * (double)options->frames) - 1;
+	double min_ms = frame_times[0];
+	double median_ms = frame_times[options->frames / 2];
+	double p99_ms = frame_times[p99_index];
+
+	printf("%-6s %6d %6d %6d %7d %9.3f %9.3f %9.3f %8lld %8lld %8lld %8lld  %08x\n",
+		   bench_scene_names[scene_kind], buffer.width, buffer.height, scene->big_cube.side_n,
+		   options->frames, min_ms, median_ms, p99_ms,
+		   drawn_face_n / options->frames, culled_face_n / options->frames, cleared_pixel_n / options->frames,
+		   damaged_pixel_n / options->frames, GetBufferChecksum(&buffer));
+
+	if(is_scaling)
+	{
+		printf("resolution: budget %.3f ms, scales %.3f to %.3f, average %.3f, last %.3f, %lld down, %lld up\n",
+			   options->budget_ms, scaler.min_scale, scaler.max_scale, scale_sum / (double)options->frames,
+			   scaler.scale, scaler.downscale_n, scaler.upscale_n);
+	}
+
+	if(options->dump_prefix)
+	{
+		char path[1024] = {};
+		snprintf(path, sizeof(path), "%s-%s.ppm", options->dump_prefix, bench_scene_names[scene_kind]);
+		DumpBuffer(&buffer, path);
+	}
+
+	if(options->record_prefix)
+	{
+		char path[1024] = {};
+		snprintf(path, sizeof(path), "%s-%s.rec", options->record_prefix, bench_scene_names[scene_kind]);
+		if(!WriteInputRecording(&recording, path)) fprintf(stderr, "cannot open %s\n", path);
+	}
+
+	if(options->profile_prefix)
+	{
+#if PROFILER_ENABLED
+		char path[1024] = {};
+		snprintf(path, sizeof(path), "%s-%s.csv", options->profile_prefix, bench_scene_names[scene_kind]);
+		if(!WriteProfileCsv(path)) fprintf(stderr, "cannot open %s\n", path);
+#else
+		fprintf(stderr, "the profiler is compiled out, no profile is written\n");
+#endif
+	}
+
+	delete[] frame_times;
+	FreeInputRecording(&recording);
+	FreeScene(scene);
+	delete scene;
+	FreeTileRenderer(renderer);
+	delete renderer;
+	FreeBuffer(&buffer);
+}
+
+// Clears the whole buffer over and over, once with normal and once with streaming stores, and prints
+// the best throughput of each.
+static void
+func RunClearBench(BenchOptions *options)
+{
+	Buffer buffer = {};
+	buffer.depth_test = options->depth_test;
+	buffer.store_cube_face_ids = options->store_cube_face_ids || options->outline_thickness > 0;
+	buffer.use_palette = options->use_palette;
+	ResizeBuffer(&buffer, options->width, options->height);
+
+	// With a palette the colors are a byte per pixel.
+	int plane_n = 1 + (buffer.store_cube_face_ids ? 1 : 0) + (buffer.depth_test ? 1 : 0);
+	double pixel_byte_n = (double)(plane_n - 1) * sizeof(unsigned int) + (buffer.use_palette ? 1.0 : sizeof(unsigned int));
+	double byte_n = (double)options->width * (double)options->height * pixel_byte_n;
+
+	double gb_per_second[2] = {};
+	for(int streaming = 0; streaming < 2; streaming++)
+	{
+		double min_seconds = 0.0;
+		for(int i = 0; i < 50; i++)
+		{
+			double start = GetSeconds();
+			ClearRect(&buffer, GetBufferRect(&buffer), 0xAAAAAA, 0, streaming != 0);
+			double seconds = GetSeconds() - start;
+			if(i == 0 || seconds < min_seconds) min_seconds = seconds;
+		}
+
+		gb_per_second[streaming] = byte_n / min_seconds / 1e9;
+	}
+
+	printf("clear: %d planes, %.1f MB, normal stores %.2f GB/s, streaming stores %.2f GB/s\n",
+		   plane_n, byte_n / 1e6, gb_per_second[0], gb_per_second[1]);
+
+	FreeBuffer(&buffer);
+}
+
+static void
+func PrintUsage(const char *program)
+{
+	fprintf(stderr,
+			"usage: %s [--width W] [--height H] [--frames N] [--warmup N]\n"
+			"       [--scene idle|spin|turn|all] [--simd none|sse2|avx2] [--threads N] [--n N]\n"
+			"       [--depth] [--ids] [--palette] [--outline T] [--dump PREFIX] [--profile PREFIX]\n"
+			"       [--record PREFIX] [--replay FILE] [--budget MS] [--min-scale S] [--max-scale S]\n"
+			"cubies along one side: %d to %d\n"
+			"--replay draws the frames of a recording instead of the scripted scenes, with the buffer size,\n"
+			"visibility and cube of the recording\n"
+			"--budget scales the buffer down while frames take longer than MS, between the min and max scale\n"
+			"--palette draws palette indices, a byte per pixel, and resolves them into colors\n",
+			program, MIN_CUBE_SIDE_N, MAX_CUBE_SIDE_N);
+}
+
+int
+func main(int argc, char **argv)
+{
+	BenchOptions options = {};
+	options.width = 1920;
+	options.height = 1080;
+	options.frames = 200;
+	options.warmup_frames = 10;
+	options.scene_kind = -1;
+	options.simd_level = SIMD_AVX2;
+	options.thread_n = (int)std::thread::hardware_concurrency();
+	if(options.thread_n < 1) options.thread_n = 1;
+	options.side_n = DEFAULT_CUBE_SIDE_N;
+	options.min_scale = 0.5f;
+	options.max_scale = 1.0f;
+
+	for(int i = 1; i < argc; i++)
+	{
+		char *arg = argv[i];
+		if(strcmp(arg, "--depth") == 0)
+		{
+			options.depth_test = true;
+			continue;
+		}
+		if(strcmp(arg, "--ids") == 0)
+		{
+			options.store_cube_face_ids = true;
+			continue;
+		}
+		if(strcmp(arg, "--palette") == 0)
+		{
+			options.use_palette = true;
+			continue;
+		}
+
+		char *value = (i + 1 < argc) ? argv[i + 1] : 0;
+
+		bool valid = (value != 0);
+		if(valid && strcmp(arg, "--width") == 0) options.width = atoi(value);
+		else if(valid && strcmp(arg, "--height") == 0) options.height = atoi(value);
+		else if(valid && strcmp(arg, "--frames") == 0) options.frames = atoi(value);
+		else if(valid && strcmp(arg, "--warmup") == 0) options.warmup_frames = atoi(value);
+		else if(valid && strcmp(arg, "--dump") == 0) options.dump_prefix = value;
+		else if(valid && strcmp(arg, "--profile") == 0) options.profile_prefix = value;
+		else if(valid && strcmp(arg, "--record") == 0) options.record_prefix = value;
+		else if(valid && strcmp(arg, "--replay") == 0) options.replay_path = value;
+		else if(valid && strcmp(arg, "--threads") == 0) options.thread_n = atoi(value);
+		else if(valid && strcmp(arg, "--n") == 0) options.side_n = atoi(value);
+		else if(valid && strcmp(arg, "--outline") == 0) options.outline_thickness = atoi(value);
+		else if(valid && strcmp(arg, "--budget") == 0) options.budget_ms = atof(value);
+		else if(valid && strcmp(arg, "--min-scale") == 0) options.min_scale = (float)atof(value);
+		else if(valid && strcmp(arg, "--max-scale") == 0) options.max_scale = (float)atof(value);
+		else if(valid && strcmp(arg, "--simd") == 0)
+		{
+			options.simd_level = -1;
+			for(int level = SIMD_NONE; level <= SIMD_AVX2; level++)
+			{
+				if(strcmp(value, bench_simd_names[level]) == 0) options.simd_level = level;
+			}
+
+			valid = (options.simd_level >= 0);
+		}
+		else if(valid && strcmp(arg, "--scene") == 0)
+		{
+			options.scene_kind = -1;
+			for(int kind = 0; kind < BENCH_REPLAY; kind++)
+			{
+				if(strcmp(value, bench_scene_names[kind]) == 0) options.scene_kind = kind;
+			}
+
+			valid = (options.scene_kind >= 0 || strcmp(value, "all") == 0);
+		}
+		else
+		{
+			valid = false;
+		}
+
+		if(!valid)
+		{
+			PrintUsage(argv[0]);
+			return 1;
+		}
+
+		i++;
+	}
+
+	if(options.width <= 0 || options.height <= 0 || options.frames <= 0 || options.warmup_frames < 0 ||
+	   options.thread_n < 1 || options.side_n < MIN_CUBE_SIDE_N || options.side_n > MAX_CUBE_SIDE_N ||
+	   options.outline_thickness < 0 || options.outline_thickness > MAX_OUTLINE_THICKNESS ||
+	   options.budget_ms < 0.0 || options.min_scale <= 0.0f || options.max_scale > 1.0f || options.min_scale > options.max_scale)
+	{
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	InputRecording replay = {};
+	if(options.replay_path)
+	{
+		if(!ReadInputRecording(&replay, options.replay_path))
+		{
+			fprintf(stderr, "cannot read the recording %s\n", options.replay_path);
+			return 1;
+		}
+
+		int frame_n = replay.header.frame_n;
+		if(options.warmup_frames >= frame_n) options.warmup_frames = frame_n - 1;
+		options.frames = frame_n - options.warmup_frames;
+		options.scene_kind = BENCH_REPLAY;
+		options.depth_test = (replay.header.depth_test != 0);
+		options.outline_thickness = replay.frames[0].outline_thickness;
+	}
+
+	LimitSimdLevel(options.simd_level);
+	printf("simd: %s, threads: %d, visibility: %s, face ids: %s, outline: %d, palette: %s\n",
+		   bench_simd_names[GetSimdLevel()], options.thread_n, options.depth_test ? "depth buffer" : "sorted",
+		   (options.store_cube_face_ids || options.outline_thickness > 0) ? "on" : "off", options.outline_thickness,
+		   options.use_palette ? "on" : "off");
+
+	printf("%-6s %6s %6s %6s %7s %9s %9s %9s %8s %8s %8s %8s  %s\n",
+		   "scene", "width", "height", "cube_n", "frames", "min_ms", "median_ms", "p99_ms", "drawn", "culled",
+		   "cleared", "damaged", "checksum");
+
+	for(int kind = 0; kind < BENCH_SCENE_N; kind++)
+	{
+		if((options.scene_kind < 0 && kind != BENCH_REPLAY) || options.scene_kind == kind)
+		{
+			RunBenchScene(&options, kind, &replay);
+		}
+	}
+
+	RunClearBench(&options);
+
+	FreeInputRecording(&replay);
+	return 0;
+}
@@ -1,39 +1,51 @@
 #include <Windows.h>
 
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 
-
-#define CUBE_N 3
+#if defined(_MSC_VER)
+#pragma comment(lib, "winmm.lib")
+#endif
 
 #define Assert(condition) if(!(condition)) DebugBreak();
 #define func
 
 #include "Math.hpp"
-
-struct Buffer
-{
-	unsigned int *colors;
-	unsigned int *cube_face_ids;
-	int width;
-	int height;
-};
+#include "Memory.hpp"
+#include "Profiler.hpp"
+#include "Render.hpp"
+#include "TileRenderer.hpp"
+#include "Scene.hpp"
+#include "FrameScheduler.hpp"
+#include "ResolutionScaler.hpp"
+#include "InputRecording.hpp"
 
 static Buffer global_buffer;
 static bool global_running;
 static bool global_left_mouse_button_down;
 static bool global_right_mouse_button_down;
-
-static void
-func ResizeBuffer(Buffer *buffer, int width, int height)
-{
-	delete buffer->colors;
-	delete buffer->cube_face_ids;
-
-	buffer->width = width;
-	buffer->height = height;
-
-	buffer->colors = new unsigned int[width * height];
-	buffer->cube_face_ids = new unsigned int[width * height];
+static int global_cube_side_n_change;
+static bool global_redraw;
+static bool global_present_all;
+static bool global_show_profile;
+static bool global_toggle_recording;
+static bool global_toggle_resolution_scaling;
+
+// The range dynamic resolution scales the buffer in, against a budget of one frame at the frame cap.
+#define MIN_RENDER_SCALE 0.5f
+#define MAX_RENDER_SCALE 1.0f
+
+static double
+func GetSeconds()
+{
+	LARGE_INTEGER counter = {};
+	LARGE_INTEGER frequency = {};
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+
+	double seconds = (double)counter.QuadPart / (double)frequency.QuadPart;
+	return seconds;
 }
 
 static LRESULT CALLBACK
@@ -45,13 +57,16 @@ func WinCallback(HWND window, UINT message, WPARAM wparam, LPARAM lparam)
 	{
 		case WM_SIZE:
 		{
-			RECT rect = {};
-			GetClientRect(window, &rect);
-			int width = rect.right - rect.left;
-			int height = rect.bottom - rect.top;
-
-			ResizeBuffer(&global_buffer, width, height);
-
+			// A drag resize sends lots of these, the buffer is only resized to the final size once per frame.
+			global_redraw = true;
+			global_present_all = true;
+			break;
+		}
+		case WM_PAINT:
+		{
+			global_redraw = true;
+			global_present_all = true;
+			result = DefWindowProc(window, message, wparam, lparam);
 			break;
 		}
 		case WM_DESTROY:
@@ -63,11 +78,13 @@ func WinCallback(HWND window, UINT message, WPARAM wparam, LPARAM lparam)
 		case WM_LBUTTONDOWN:
 		{
 			global_left_mouse_button_down = true;
+			SetCapture(window);
 			break;
 		}
 		case WM_LBUTTONUP:
 		{
 			global_left_mouse_button_down = false;
+			ReleaseCapture();
 			break;
 		}
 		case WM_RBUTTONDOWN:
@@ -80,6 +97,43 @@ func WinCallback(HWND window, UINT message, WPARAM wparam, LPARAM lparam)
 			global_right_mouse_button_down = false;
 			break;
 		}
+		case WM_KEYDOWN:
+		{
+			if(wparam == VK_ADD || wparam == VK_OEM_PLUS) global_cube_side_n_change++;
+			else if(wparam == VK_SUBTRACT || wparam == VK_OEM_MINUS) global_cube_side_n_change--;
+			else if(wparam == 'O')
+			{
+				// Cycles between drawn edge lines and outlines of growing thickness.
+				int outline_thickness = (global_buffer.outline_thickness + 1) % 4;
+				SetBufferOutline(&global_buffer, outline_thickness, 0x000000);
+				global_redraw = true;
+			}
+			else if(wparam == 'R')
+			{
+				global_toggle_recording = true;
+			}
+			else if(wparam == 'D')
+			{
+				global_toggle_resolution_scaling = true;
+			}
+			else if(wparam == 'I')
+			{
+				SetBufferUsePalette(&global_buffer, !global_buffer.use_palette);
+				global_redraw = true;
+			}
+#if PROFILER_ENABLED
+			else if(wparam == 'P')
+			{
+				global_show_profile = !global_show_profile;
+				global_redraw = true;
+			}
+			else if(wparam == 'C')
+			{
+				WriteProfileCsv("profile.csv");
+			}
+#endif
+			break;
+		}
 		default:
 		{
 			result = DefWindowProc(window, message, wparam, lparam);
@@ -90,788 +144,304 @@ func WinCallback(HWND window, UINT message, WPARAM wparam, LPARAM lparam)
 	return result;
 }
 
-static void
-func SetPixelColor(Buffer *buffer, int row, int col, unsigned int color)
+int CALLBACK
+func WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmd_line, int cmd_show)
 {
-	Assert(row >= 0 && row < buffer->height);
-	Assert(col >= 0 && col < buffer->width);
+	WNDCLASSA win_class = {};
+	win_class.style = CS_OWNDC;
+	win_class.lpfnWndProc = WinCallback;
+	win_class.hInstance = instance;
+	win_class.lpszClassName = "CubeWC";
 
-	buffer->colors[row * buffer->width + col] = color;
-}
+	RegisterClassA(&win_class);
 
-static void
-func SetPixelCubeFaceId(Buffer *buffer, int row, int col, unsigned int cube_face_id)
-{
-	Assert(row >= 0 && row < buffer->height);
-	Assert(col >= 0 && col < buffer->width);
+	global_buffer.depth_test = true;
 
-	buffer->cube_face_ids[row * buffer->width + col] = cube_face_id;
-}
+	HWND window = CreateWindowExA(
+		0,
+		win_class.lpszClassName,
+		"Cube",
+		WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+		CW_USEDEFAULT,
+		CW_USEDEFAULT,
+		CW_USEDEFAULT,
+		CW_USEDEFAULT,
+		0,
+		0,
+		instance,
+		0
+	);
+	Assert(window != 0);
 
-static unsigned int
-func GetPixelColorChecked(Buffer *buffer, int row, int col)
-{
-	unsigned int color = 0;
-	if((row >= 0 && row < buffer->height) && (col >= 0 && col < buffer->width))
+	// The command line is "[cubies along a side] [frame cap] [recording]", the number of cubies can be changed
+	// with + and - and O switches between edge lines and outlines. P shows the frame profile, C writes it to
+	// profile.csv. R starts recording the input and stops it again, writing it to input.rec. D turns dynamic
+	// resolution on and off, it draws into a smaller buffer while frames take longer than the frame cap allows.
+	// I switches between drawing colors and drawing palette indices that are resolved into colors afterwards.
+	// Without a frame cap frames are paced to the refresh rate of the display, a cap of 0 turns pacing off.
+	// A recording given on the command line is played back first, one recorded frame per drawn frame.
+	char *cmd_line_end = cmd_line;
+	int side_n = strtol(cmd_line, &cmd_line_end, 10);
+	if(side_n < MIN_CUBE_SIDE_N || side_n > MAX_CUBE_SIDE_N) side_n = DEFAULT_CUBE_SIDE_N;
+
+	char *frame_cap_end = cmd_line_end;
+	int frame_cap = strtol(cmd_line_end, &frame_cap_end, 10);
+	if(frame_cap_end == cmd_line_end || frame_cap < 0)
 	{
-		color = buffer->colors[row * buffer->width + col];
-	}
-
-	return color;
-}
+		HDC context = GetDC(window);
+		frame_cap = GetDeviceCaps(context, VREFRESH);
+		ReleaseDC(window, context);
 
-static unsigned int
-func GetPixelCubeFaceIdChecked(Buffer *buffer, int row, int col)
-{
-	unsigned int cube_face_id = 0;
-	if((row >= 0 && row < buffer->height) && (col >= 0 && col < buffer->width))
-	{
-		cube_face_id = buffer->cube_face_ids[row * buffer->width + col];
+		if(frame_cap <= 1) frame_cap = 60;
 	}
 
-	return cube_face_id;
-}
+	char *replay_path = frame_cap_end;
+	while(*replay_path == ' ') replay_path++;
 
-struct BresenhamContext
-{
-	int x1, y1;
-	int x2, y2;
-	int abs_x, abs_y;
-	int add_x, add_y;
-	int error, error2;
-};
-
-static BresenhamContext
-func BresenhamInit(V2 p1, V2 p2)
-{
-	BresenhamContext context = {};
-	context.x1 = (int)p1.x;
-	context.y1 = (int)p1.y;
-	context.x2 = (int)p2.x;
-	context.y2 = (int)p2.y;
+	FrameScheduler scheduler = {};
+	InitFrameScheduler(&scheduler, frame_cap);
 
-	context.abs_x = IntAbs(context.x1 - context.x2);
-	context.abs_y = IntAbs(context.y1 - context.y2);
+	double budget_seconds = 1.0 / (double)((frame_cap > 0) ? frame_cap : 60);
+	ResolutionScaler scaler = {};
+	InitResolutionScaler(&scaler, budget_seconds, MIN_RENDER_SCALE, MAX_RENDER_SCALE);
 
-	context.add_x = 1;
-	if(context.x1 > context.x2) context.add_x = -1;
+	// Sleeps for the frame cap need to be shorter than the default timer period.
+	timeBeginPeriod(1);
 
-	context.add_y = 1;
-	if(context.y1 > context.y2) context.add_y = -1;
+	static Scene scene;
+	InitScene(&scene, side_n, 100.0f);
 
-	context.error = 0;
-	if(context.abs_x > context.abs_y) context.error = context.abs_x / 2;
-	else context.error = -context.abs_y / 2;
+	int thread_n = (int)std::thread::hardware_concurrency();
+	if(thread_n < 1) thread_n = 1;
 
-	context.error2 = 0;
+	TileRenderer *renderer = new TileRenderer();
+	InitTileRenderer(renderer, thread_n);
 
-	return context;
-}
+	Buffer *buffer = &global_buffer;
 
-static void
-func BresenhamAdvance(BresenhamContext *context)
-{
-	context->error2 = context->error;
-	if(context->error2 > -context->abs_x)
-	{
-		context->error -= context->abs_y;
-		context->x1 += context->add_x;
-	}
-	if(context->error2 < context->abs_y)
+	static InputRecording recording;
+	bool is_recording = false;
+
+	static InputRecording replay;
+	int replay_frame = 0;
+	bool is_replaying = false;
+	if(*replay_path != 0 && ReadInputRecording(&replay, replay_path))
 	{
-		context->error += context->abs_x;
-		context->y1 += context->add_y;
+		StartInputReplay(&replay, &scene, buffer);
+		is_replaying = true;
 	}
-}
 
-static void
-func Bresenham(Buffer *buffer, V2 p1, V2 p2, unsigned int color)
-{
-	BresenhamContext context = BresenhamInit(p1, p2);
-	while(1)
+	global_running = true;
+	double last_title_seconds = GetSeconds();
+	while(global_running)
 	{
-		SetPixelColor(buffer, context.y1, context.x1, color);
-		if(context.x1 == context.x2 && context.y1 == context.y2)
+		MSG message = {};
+		while(PeekMessage(&message, 0, 0, 0, PM_REMOVE))
 		{
-			break;
+			TranslateMessage(&message);
+			DispatchMessage(&message);
 		}
 
-		BresenhamAdvance(&context);
-	}
-}
-
-
-static V2
-func ProjectToScreen(V3 p3)
-{
-	V2 p2 = Point2(p3.x, p3.y);
-	return p2;
-}
-
-static void
-func DrawLine3(Buffer *buffer, V3 p1, V3 p2, unsigned int color)
-{
-	V2 p1_projected = ProjectToScreen(p1);
-	V2 p2_projected = ProjectToScreen(p2);
-	Bresenham(buffer, p1_projected, p2_projected, color);
-}
-
-static void
-func DrawQuad2(Buffer *buffer, Quad2 quad, unsigned int color, unsigned int cube_face_id)
-{
-	Assert(IsValidQuad2(quad));
-
-	float min_x = quad.p[0].x;
-	float max_x = quad.p[0].x;
-	float min_y = quad.p[0].y;
-	float max_y = quad.p[0].y;
-	for(int i = 1; i < 4; i++)
-	{
-		float x = quad.p[i].x;
-		float y = quad.p[i].y;
-		if(x < min_x) min_x = x;
-		if(x > max_x) max_x = x;
-		if(y < min_y) min_y = y;
-		if(y > max_y) max_y = y;
-	}
+		// Rebuilding the cube at its current size would also put it back to solved, replays would miss that.
+		if(global_cube_side_n_change != 0)
+		{
+			int side_n = scene.big_cube.side_n + global_cube_side_n_change;
+			if(side_n >= MIN_CUBE_SIDE_N && side_n <= MAX_CUBE_SIDE_N) ResizeSceneCube(&scene, side_n);
+			global_cube_side_n_change = 0;
+			global_redraw = true;
+		}
 
-	for(int row = (int)(min_y); row < (int)(max_y) + 1; row++)
-	{
-		for(int col = (int)(min_x); col < (int)(max_x) + 1; col++)
+		if(global_toggle_recording)
 		{
-			V2 p = Point2((float)col, (float)row);
-			if(IsPointInQuad2(p, quad))
+			if(is_recording)
 			{
-				SetPixelColor(buffer, row, col, color);
-				SetPixelCubeFaceId(buffer, row, col, cube_face_id);
+				WriteInputRecording(&recording, "input.rec");
+				FreeInputRecording(&recording);
+				is_recording = false;
+			}
+			else if(!is_replaying)
+			{
+				StartInputRecording(&recording, &scene, buffer);
+				is_recording = true;
 			}
-		}
-	}
-}
-
-
-static void
-func DrawQuad3(Buffer *buffer, Quad3 quad3, unsigned int color, unsigned int cube_face_id)
-{
-	Quad2 quad2 = {};
-	for(int i = 0; i < 4; i++)
-	{
-		quad2.p[i] = ProjectToScreen(quad3.p[i]);
-	}
-
-	if(IsValidQuad2(quad2)) DrawQuad2(buffer, quad2, color, cube_face_id);
-}
-
-enum CubeCorner
-{
-	CORNER_LUF,
-	CORNER_LUB,
-	CORNER_LDF,
-	CORNER_LDB,
-	CORNER_RUF,
-	CORNER_RUB,
-	CORNER_RDF,
-	CORNER_RDB
-};
-
-V3 unit_cube_corners[8] =
-{
-	{-1.0, +1.0, +1.0f},
-	{-1.0, +1.0, -1.0f},
-	{-1.0, -1.0, +1.0f},
-	{-1.0, -1.0, -1.0f},
-	{+1.0, +1.0, +1.0f},
-	{+1.0, +1.0, -1.0f},
-	{+1.0, -1.0, +1.0f},
-	{+1.0, -1.0, -1.0f}
-};
-
-enum CubeFace
-{
-	FACE_L,
-	FACE_R,
-	FACE_U,
-	FACE_D,
-	FACE_F,
-	FACE_B
-};
-
-int cube_face_corners[6][4] =
-{
-	{CORNER_LUB, CORNER_LUF, CORNER_LDF, CORNER_LDB},
-	{CORNER_RUF, CORNER_RUB, CORNER_RDB, CORNER_RDF},
-	{CORNER_LUF, CORNER_LUB, CORNER_RUB, CORNER_RUF},
-	{CORNER_LDB, CORNER_LDF, CORNER_RDF, CORNER_RDB},
-	{CORNER_LUF, CORNER_RUF, CORNER_RDF, CORNER_LDF},
-	{CORNER_LUB, CORNER_LDB, CORNER_RDB, CORNER_RUB}
-};
-
-int cube_edges[12][2] =
-{
-	{CORNER_LUF, CORNER_RUF}, {CORNER_RUF, CORNER_RUB},
-	{CORNER_RUB, CORNER_LUB}, {CORNER_LUB, CORNER_LUF},
-
-	{CORNER_LDF, CORNER_RDF}, {CORNER_RDF, CORNER_RDB},
-	{CORNER_RDB, CORNER_LDB}, {CORNER_LDB, CORNER_LDF},
-
-	{CORNER_LUF, CORNER_LDF}, {CORNER_RUF, CORNER_RDF},
-	{CORNER_LUB, CORNER_LDB}, {CORNER_RUB, CORNER_RDB}
-};
-
-unsigned int cube_face_colors[6] =
-{
-	0xFF8800,
-	0xFF0000,
-	0xFFFFFF,
-	0xFFFF00,
-	0x00FF00,
-	0x0000FF
-};
-
-struct Cube
-{
-	Quat rotations;
-	V3 center_base;
-	V3 center_final;
-	int id;
-	float radius;
-	bool is_rotating;
-};
-
-static V3
-func GetCubeFaceNormalVector(int face_id)
-{
-	V3 normal = {};
 
-	switch(face_id)
-	{
-		case FACE_L:
-		{
-			normal = Vector3(-1, 0, 0);
-			break;
+			global_toggle_recording = false;
+			global_redraw = true;
 		}
-		case FACE_R:
-		{
-			normal = Vector3(+1, 0, 0);
-			break;
-		}
-		case FACE_U:
-		{
-			normal = Vector3(0, +1, 0);
-			break;
-		}
-		case FACE_D:
-		{
-			normal = Vector3(0, -1, 0);
-			break;
-		}
-		case FACE_F:
-		{
-			normal = Vector3(0, 0, +1);
-			break;
-		}
-		case FACE_B:
-		{
-			normal = Vector3(0, 0, -1);
-			break;
-		}
-		default:
-		{
-			DebugBreak();
-		}
-	}
-
-	return normal;
-}
-
-static float
-func Dot2(V2 v1, V2 v2)
-{
-	float prod = v1.x * v2.x + v1.y * v2.y;
-	return prod;
-}
-
-static float
-func Dot3(V3 v1, V3 v2)
-{
-	float prod = v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
-	return prod;
-}
-
-static void
-func DrawCube(Buffer *buffer, Cube cube, Quat rotations)
-{
-	V3 cube_corners[8] = {};
-	for(int corner_id = 0; corner_id < 8; corner_id++)
-	{
-		V3 local_corner = QuatRotate(rotations * cube.rotations, unit_cube_corners[corner_id]);
-		cube_corners[corner_id] = cube.center_final + cube.radius * local_corner;
-	}
 
-	for(int face_id = 0; face_id < 6; face_id++)
-	{
-		Quad3 q3 = {};
-		for(int face_corner_id = 0; face_corner_id < 4; face_corner_id++)
+		if(global_toggle_resolution_scaling)
 		{
-			int corner_id = cube_face_corners[face_id][face_corner_id];
-			q3.p[face_corner_id] = cube_corners[corner_id];
+			EnableResolutionScaler(&scaler, !scaler.is_enabled);
+			global_toggle_resolution_scaling = false;
+			global_redraw = true;
 		}
 
-		unsigned int color = cube_face_colors[face_id];
-		unsigned int cube_face_id = 6 * cube.id + face_id;
-		DrawQuad3(buffer, q3, color, cube_face_id);
-	}
-
-	float min_corner_z = cube_corners[0].z;
-	for(int corner_id = 0; corner_id < 8; corner_id++)
-	{
-		V3 corner = cube_corners[corner_id];
-		if(corner.z < min_corner_z) min_corner_z = corner.z;
-	}
-
-	unsigned int edge_color = 0x000000;
-	for(int edge_id = 0; edge_id < 12; edge_id++)
-	{
-		int corner_id1 = cube_edges[edge_id][0];
-		int corner_id2 = cube_edges[edge_id][1];
-
-		V3 corner1 = cube_corners[corner_id1];
-		V3 corner2 = cube_corners[corner_id2];
-
-		if(corner1.z > min_corner_z && corner2.z > min_corner_z)
+		if(global_redraw)
 		{
-			DrawLine3(buffer, corner1, corner2, edge_color);
+			MarkFrameDirty(&scheduler);
+			global_redraw = false;
 		}
-	}
-}
-
-static V3
-func CrossProduct(V3 v1, V3 v2)
-{
-	/*
-	   x    y    z
-	v1.x v1.y v1.z
-	v2.x v2.y v2.z
-	*/
-
-	V3 result = {};
-	result.x = v1.y * v2.z - v1.z * v2.y;
-	result.y = v1.z * v2.x - v1.x * v2.z;
-	result.z = v1.x * v2.y - v1.y * v2.x;
-	return result;
-}
 
-static bool
-func IsRightHandedSystem(V3 x, V3 y, V3 z)
-{
-	V3 cross_xy = CrossProduct(x, y);
-	float dot = Dot3(cross_xy, z);
-	bool is_right_handed = (dot > 0.0f);
-	return is_right_handed;
-}
-
-static V3
-func ShiftVector(V3 v)
-{
-	V3 r = {};
-	r.y = v.x;
-	r.z = v.y;
-	r.x = v.z;
-	return r;
-}
-
-
-static void
-func SwapCubes(Cube *cube1, Cube *cube2)
-{
-	Cube tmp = *cube1;
-	*cube1 = *cube2;
-	*cube2 = tmp;
-}
-
-static bool
-func CubesAreInOrder(Cube first_cube, Cube second_cube, V3 rotation_axis_final, V3 screen_center)
-{
-	bool in_order = true;
-
-	float distance1 = Dot3(first_cube.center_final - screen_center, rotation_axis_final);
-	float distance2 = Dot3(second_cube.center_final - screen_center, rotation_axis_final);
-
-	if(Abs(distance1 - distance2) > first_cube.radius)
-	{
-		V3 layer_center1 = screen_center + distance1 * rotation_axis_final;
-		V3 layer_center2 = screen_center + distance2 * rotation_axis_final;
-		in_order = (layer_center1.z < layer_center2.z);
-	}
-	else
-	{
-		in_order = (first_cube.center_final.z < second_cube.center_final.z);
-	}
+		RECT rect = {};
+		GetClientRect(window, &rect);
 
-	return in_order;
-}
+		int width = rect.right - rect.left;
+		int height = rect.bottom - rect.top;
 
-static void
-func SortCubes(Cube *cubes, int cube_n, V3 rotation_axis, V3 screen_center)
-{
-	int i = 1;
-	while(i < cube_n)
-	{
-		int j = i;
-		while(j > 0 && !CubesAreInOrder(cubes[j - 1], cubes[j], rotation_axis, screen_center))
+		Input input = {};
+		if(is_replaying)
 		{
-			SwapCubes(&cubes[j - 1], &cubes[j]);
-			j--;
+			input = GetReplayInput(&replay, replay_frame, &scene, buffer);
+			MarkFrameDirty(&scheduler);
 		}
-		i++;
-	}
-}
-
-struct BigCube
-{
-	Quat rotations;
-
-	Cube cubes[CUBE_N * CUBE_N * CUBE_N];
-	int cube_n;
-};
-
-static BigCube
-func InitBigCube()
-{
-	float side_radius = 100.0f;
-	float small_side_radius = side_radius / (float)CUBE_N;
-
-	BigCube big_cube = {};
-	big_cube.cube_n = sizeof(big_cube.cubes) / sizeof(big_cube.cubes[0]);
-	big_cube.rotations = GetIdentityRotationQuat();
-
-	int cube_id = 0;
-	for(int x = 0; x < CUBE_N; x++)
-	{
-		float x_offset = (-CUBE_N + 1.0f) + (2.0f * x);
-		for(int y = 0; y < CUBE_N; y++)
+		else
 		{
-			float y_offset = (-CUBE_N + 1.0f) + (2.0f * y);
-			for(int z = 0; z < CUBE_N; z++)
-			{
-				float z_offset = (-CUBE_N + 1.0f) + (2.0f * z);
+			POINT cursor_point = {};
+			GetCursorPos(&cursor_point);
+			ScreenToClient(window, &cursor_point);
 
-				V3 offset_base = small_side_radius * Vector3(x_offset, y_offset, z_offset);
+			input.mouse_position = Point2((float)cursor_point.x, (float)(height - cursor_point.y));
+			input.left_mouse_button_down = global_left_mouse_button_down;
+			input.right_mouse_button_down = global_right_mouse_button_down;
 
-				Cube *cube = &big_cube.cubes[cube_id];
-				cube_id++;
+			// The scene is drawn at the scale of the scaler while it changes and sharp again once it stands still.
+			float render_scale = scaler.scale;
+			bool is_still = !scheduler.is_dirty && !InputChangesScene(scheduler.last_input, input) &&
+							GetSeconds() - scheduler.last_frame_seconds >= RESOLUTION_STILL_SECONDS;
+			if(is_still) render_scale = scaler.max_scale;
 
-				cube->id = cube_id;
-
-				cube->rotations = GetIdentityRotationQuat();
-				cube->center_base = offset_base;
-				cube->radius = small_side_radius;
+			if(scene.render_scale != render_scale)
+			{
+				scene.render_scale = render_scale;
+				MarkFrameDirty(&scheduler);
 			}
-		}
-	}
 
-	return big_cube;
-}
-
-static float
-func RoundToHalfPi(float x)
-{
-	float half_pi = 0.5f * 3.141592653589793238462643383f;
-	float rounded_x = x;
-
-	int times = (int)(x / half_pi);
-
-	float low = (float)times * half_pi;
-	if(x < 0) low -= half_pi;
-
-	float high = low + half_pi;
-	Assert(low <= x);
-	Assert(x <= high);
-
-	float low_abs = x - low;
-	float high_abs = high - x;
-	if(low_abs < high_abs) rounded_x = low;
-	else rounded_x = high;
-
-	return rounded_x;
-}
-
-static void
-func DrawScene(Buffer *buffer, BigCube *big_cube, V2 mouse_position)
-{
-	static bool is_rotating = false;
-	static bool big_cube_rotation = false;
-
-	static int rotating_cube_id;
-	static int rotating_face_id;
-	static V2 clicked_pixel;
-	static V3 rotation1_vector;
-	static V3 rotation2_vector;
-	static V2 rotation1_vector_pixel;
-	static V2 rotation2_vector_pixel;
-
-	bool is_side_rotating = (is_rotating && !big_cube_rotation);
-
-	unsigned int color = 0xAAAAAA;
-	unsigned int *pixel = buffer->colors;
-	unsigned int *cube_face_id = buffer->cube_face_ids;
-	for(int row = 0; row < buffer->height; row++)
-	{
-		for(int col = 0; col < buffer->width; col++)
-		{
-			*pixel = color;
-			pixel++;
-
-			*cube_face_id = 0;
-			cube_face_id++;
-		}
-	}
-
-	static V2 prev_mouse_position;
-
-	V2 mouse_position_diff = mouse_position - prev_mouse_position;
-
-	prev_mouse_position = mouse_position;
-
-	if(is_rotating && big_cube_rotation)
-	{
-		float theta_y = mouse_position_diff.x / 100.0f;
-		V3 y_axis = Vector3(0.0f, 1.0f, 0.0f);
-		Quat quat_y = GetRotationQuat(y_axis, theta_y);
-
-		float theta_x = (-mouse_position_diff.y) / 100.0f;
-		V3 x_axis = Vector3(1.0f, 0.0f, 0.0f);
-		Quat quat_x = GetRotationQuat(x_axis, theta_x);
-
-	
-		big_cube->rotations = quat_x * quat_y * big_cube->rotations;
-	}
-
-	V3 screen_center = 0.5f * Point3((float)buffer->width, (float)buffer->height, 0.0f);
-	for(int i = 0; i < big_cube->cube_n; i++)
-	{
-		Cube *cube = &big_cube->cubes[i];
-		cube->center_final = screen_center + QuatRotate(big_cube->rotations, cube->center_base);
-	}
-
-	for(int i = 0; i < big_cube->cube_n; i++)
-	{
-		big_cube->cubes[i].is_rotating = false;
-	}
-
-	Quat side_rotation = GetIdentityRotationQuat();
-	V3 rotation_vector = Vector3(0, 0, 0);
-	V3 rotation_perp_vector = Vector3(0, 0, 0);
-	if(is_side_rotating)
-	{
-		if(global_right_mouse_button_down)
-		{
-			DebugBreak();
-			global_right_mouse_button_down = false;
+			int buffer_width = GetScaledSize(width, render_scale);
+			int buffer_height = GetScaledSize(height, render_scale);
+			if(buffer->width != buffer_width || buffer->height != buffer_height)
+			{
+				ResizeBuffer(buffer, buffer_width, buffer_height);
+			}
 		}
 
-		V2 mouse_diff = mouse_position - clicked_pixel;
-		float rotation1_distance = Dot2(mouse_diff, rotation1_vector_pixel);
-		float rotation2_distance = Dot2(mouse_diff, rotation2_vector_pixel);
-
-		bool use_rotation1 = (Abs(rotation1_distance) > Abs(rotation2_distance));
-
-		V3 rotation_vector_base = use_rotation1 ? rotation1_vector : rotation2_vector;
-		V3 rotation_perp_vector_base = use_rotation1 ? rotation2_vector : -rotation1_vector;
-
-		rotation_vector = QuatRotate(big_cube->rotations, rotation_vector_base);
-		rotation_perp_vector = QuatRotate(big_cube->rotations, rotation_perp_vector_base);
-
-		float rotation_distance = use_rotation1 ? rotation1_distance : rotation2_distance;
-		float theta = rotation_distance / 50.0f;
-
-		side_rotation = GetRotationQuat(rotation_perp_vector_base, theta);
-
-		Cube *rotating_cube = 0;
-		for(int i = 0; i < big_cube->cube_n; i++)
+		double seconds = GetSeconds();
+		if(ShouldDrawFrame(&scheduler, input, seconds))
 		{
-			if(big_cube->cubes[i].id == rotating_cube_id) rotating_cube = &big_cube->cubes[i];
-		}
-		Assert(rotating_cube);
+			if(is_recording) RecordInputFrame(&recording, buffer, &scene, input);
 
-		float cube_radius = rotating_cube->radius;
+			PROFILE_BEGIN_FRAME();
+			DrawScene(buffer, renderer, &scene, input);
 
-		float base_perp_distance = Dot3(rotating_cube->center_final, rotation_perp_vector);
-		for(int i = 0; i < big_cube->cube_n; i++)
-		{
-			Cube *cube = &big_cube->cubes[i];
-			float perp_distance = Dot3(cube->center_final, rotation_perp_vector);
-			if(Abs(perp_distance - base_perp_distance) < cube_radius)
+#if PROFILER_ENABLED
+			if(global_show_profile)
 			{
-				cube->is_rotating = true;
-
-				V3 center_base_rotated = QuatRotate(side_rotation, cube->center_base);
-				cube->center_final = screen_center + QuatRotate(big_cube->rotations, center_base_rotated);
+				DrawProfileOverlay(buffer->colors, buffer->width, buffer->height, buffer->pitch);
+				ForgetTileContents(renderer);
 			}
-			else
-			{
-				cube->is_rotating = false;
-			}
-		}
+#endif
 
-		if(!global_left_mouse_button_down)
-		{
-			float rounded_theta = RoundToHalfPi(theta);
-			Quat rotation_to_apply = GetRotationQuat(rotation_perp_vector_base, rounded_theta);
-			for(int i = 0; i < big_cube->cube_n; i++)
 			{
-				Cube *cube = &big_cube->cubes[i];
-				if(cube->is_rotating)
+				PROFILE_SCOPE(PROFILE_PRESENT);
+
+				HDC context = GetDC(window);
+				BITMAPINFO bitmap_info = {};
+				BITMAPINFOHEADER *header = &bitmap_info.bmiHeader;
+				header->biSize = sizeof(*header);
+				header->biWidth = buffer->pitch;
+				header->biHeight = buffer->height;
+				header->biPlanes = 1;
+				header->biBitCount = 32;
+				header->biCompression = BI_RGB;
+
+				// Only the damage of the frame is uploaded, unless the window lost its contents or the overlay
+				// was drawn over the frame.
+				ClipRect buffer_rect = GetBufferRect(buffer);
+				ClipRect *present_rects = renderer->damage_rects;
+				int present_rect_n = renderer->damage_rect_n;
+				if(global_present_all || global_show_profile)
 				{
-					cube->rotations = rotation_to_apply * cube->rotations;
-					cube->center_base = QuatRotate(rotation_to_apply, cube->center_base);
-					cube->is_rotating = false;
+					present_rects = &buffer_rect;
+					present_rect_n = 1;
+					global_present_all = false;
 				}
-			}
-
-			side_rotation = GetIdentityRotationQuat();
-			is_rotating = false;
-		}
-	}
-
-	SortCubes(big_cube->cubes, big_cube->cube_n, rotation_perp_vector, screen_center);
-
-	Quat side_rotation_quat = big_cube->rotations * side_rotation;
-	for(int i = 0; i < big_cube->cube_n; i++)
-	{
-		Cube cube = big_cube->cubes[i];
 
-		Quat cube_transform = big_cube->rotations;
-
-		if(cube.is_rotating) cube_transform = side_rotation_quat;
-
-		DrawCube(buffer, cube, cube_transform);
-	}
+				// The bitmap is pitch pixels wide, only its first width columns are shown. Its rows go up
+				// from the bottom of the window, so do the source rows of StretchDIBits.
+				for(int i = 0; i < present_rect_n; i++)
+				{
+					ClipRect rect = present_rects[i];
+					if(IsRectEmpty(rect)) continue;
+
+					int dest_left = rect.min_col * width / buffer->width;
+					int dest_right = (rect.max_col + 1) * width / buffer->width;
+					int dest_top = height - (rect.max_row + 1) * height / buffer->height;
+					int dest_bottom = height - rect.min_row * height / buffer->height;
+
+					StretchDIBits(context,
+								  dest_left, dest_top, dest_right - dest_left, dest_bottom - dest_top,
+								  rect.min_col, rect.min_row, rect.max_col - rect.min_col + 1, rect.max_row - rect.min_row + 1,
+								  buffer->colors,
+								  &bitmap_info,
+								  DIB_RGB_COLORS,
+								  SRCCOPY
+					);
+				}
+				ReleaseDC(window, context);
+			}
 
-	unsigned int picked_color = GetPixelColorChecked(buffer, (int)mouse_position.y, (int)mouse_position.x);
-	unsigned int picked_cube_face_id = GetPixelCubeFaceIdChecked(buffer, (int)mouse_position.y, (int)mouse_position.x);
-	int picked_cube_id = picked_cube_face_id / 6;
-	int picked_face_id = picked_cube_face_id % 6;
+			PROFILE_END_FRAME();
 
-	Cube *cube_at_mouse = 0;
-	for(int i = 0; i < big_cube->cube_n; i++)
-	{
-		if(big_cube->cubes[i].id == picked_cube_id)
-		{
-			cube_at_mouse = &big_cube->cubes[i];
-		}
-	}
+			// Only frames at the scale the scaler picked tell it something about that scale.
+			double frame_seconds = GetSeconds() - seconds;
+			if(!is_replaying && scene.render_scale == scaler.scale) UpdateResolutionScale(&scaler, frame_seconds);
 
-	if(!global_left_mouse_button_down)
-	{
-		is_rotating = false;
-	}
-	else if(!is_rotating)
-	{
-		is_rotating = true;
-		if(cube_at_mouse == 0)
-		{
-			big_cube_rotation = true;
+			if(is_replaying)
+			{
+				replay_frame++;
+				if(replay_frame == replay.header.frame_n)
+				{
+					FreeInputRecording(&replay);
+					is_replaying = false;
+					global_redraw = true;
+				}
+			}
 		}
 		else
 		{
-			big_cube_rotation = false;
-			rotating_cube_id = picked_cube_id;
-			rotating_face_id = picked_face_id;
-
-			clicked_pixel = mouse_position;
-
-			float rotation_line_length = cube_at_mouse->radius;
-			V3 face_normal = QuatRotate(cube_at_mouse->rotations, GetCubeFaceNormalVector(rotating_face_id));
-
-			rotation1_vector = ShiftVector(face_normal);
-			rotation2_vector = ShiftVector(rotation1_vector);
+			// Sleep until the next message, or until the frame cap lets the pending frame through.
+			double wait_seconds = GetFrameWaitSeconds(&scheduler, seconds);
+			DWORD wait_ms = (wait_seconds < 0.0) ? INFINITE : (DWORD)ceil(1000.0 * wait_seconds);
+			MsgWaitForMultipleObjectsEx(0, 0, wait_ms, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+		}
 
-			if(!IsRightHandedSystem(face_normal, rotation1_vector, rotation2_vector))
+		if(seconds - last_title_seconds >= 1.0)
+		{
+			char scaling[128] = {};
+			if(scaler.is_enabled)
 			{
-				rotation2_vector = -rotation2_vector;
+				snprintf(scaling, sizeof(scaling), ", scale: %.3f (down %lld, up %lld)",
+						 scaler.scale, scaler.downscale_n, scaler.upscale_n);
 			}
-			Assert(IsRightHandedSystem(face_normal, rotation1_vector, rotation2_vector));
 
-			rotation1_vector_pixel = ProjectToScreen(QuatRotate(big_cube->rotations, rotation1_vector));
-			rotation2_vector_pixel = ProjectToScreen(QuatRotate(big_cube->rotations, rotation2_vector));
+			char title[384] = {};
+			snprintf(title, sizeof(title), "Cube - %dx%dx%d, frames drawn: %lld, idle wakeups: %lld, capped wakeups: %lld%s%s",
+					 scene.big_cube.side_n, scene.big_cube.side_n, scene.big_cube.side_n, scheduler.drawn_frame_n,
+					 scheduler.idle_wakeup_n, scheduler.capped_wakeup_n, scaling,
+					 is_recording ? ", recording" : (is_replaying ? ", replaying" : ""));
+			SetWindowTextA(window, title);
+			last_title_seconds = seconds;
 		}
 	}
-}
-
-int CALLBACK
-func WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmd_line, int cmd_show)
-{
-	WNDCLASSA win_class = {};
-	win_class.style = CS_OWNDC;
-	win_class.lpfnWndProc = WinCallback;
-	win_class.hInstance = instance;
-	win_class.lpszClassName = "CubeWC";
-
-	RegisterClassA(&win_class);
-	HWND window = CreateWindowExA(
-		0,
-		win_class.lpszClassName,
-		"Cube",
-		WS_OVERLAPPEDWINDOW | WS_VISIBLE,
-		CW_USEDEFAULT,
-		CW_USEDEFAULT,
-		CW_USEDEFAULT,
-		CW_USEDEFAULT,
-		0,
-		0,
-		instance,
-		0
-	);
-	Assert(window != 0);
-
-	BigCube big_cube = InitBigCube();
-
-	Buffer *buffer = &global_buffer;
-	global_running = true;
-	while(global_running)
-	{
-		MSG message = {};
-		while(PeekMessage(&message, 0, 0, 0, PM_REMOVE))
-		{
-			TranslateMessage(&message);
-			DispatchMessage(&message);
-		}
 
-		HDC context = GetDC(window);
-		BITMAPINFO bitmap_info = {};
-		BITMAPINFOHEADER *header = &bitmap_info.bmiHeader;
-		header->biSize = sizeof(*header);
-		header->biWidth = buffer->width;
-		header->biHeight = buffer->height;
-		header->biPlanes = 1;
-		header->biBitCount = 32;
-		header->biCompression = BI_RGB;
+	timeEndPeriod(1);
 
-		RECT rect = {};
-		GetClientRect(window, &rect);
-
-		int width = rect.right - rect.left;
-		int height = rect.bottom - rect.top;
+	if(is_recording) WriteInputRecording(&recording, "input.rec");
+	FreeInputRecording(&recording);
+	FreeInputRecording(&replay);
 
-		POINT cursor_point = {};
-		GetCursorPos(&cursor_point);
-		ScreenToClient(window, &cursor_point);
-
-		V2 mouse_position = Point2((float)cursor_point.x, (float)(height - cursor_point.y));
-
-		DrawScene(buffer, &big_cube, mouse_position);
-
-		StretchDIBits(context,
-					  0, 0, buffer->width, buffer->height,
-					  0, 0, width, height,
-					  buffer->colors,
-					  &bitmap_info,
-					  DIB_RGB_COLORS,
-					  SRCCOPY
-		);
-		ReleaseDC(window, context);
-	}
+	FreeTileRenderer(renderer);
+	delete renderer;
+	FreeScene(&scene);
 
 	return 0;
 }
@@ -0,0 +1,84 @@
+// Decides when the platform layer draws a new frame. A frame is only drawn when something changed since
+// the last one, and frames are never closer to each other than the frame cap allows.
+struct FrameScheduler
+{
+	double min_frame_seconds;
+	double last_frame_seconds;
+
+	bool is_dirty;
+	Input last_input;
+
+	long long drawn_frame_n;
+	long long idle_wakeup_n;
+	long long capped_wakeup_n;
+};
+
+// A frame_cap of 0 draws changed frames as soon as possible.
+static void
+func InitFrameScheduler(FrameScheduler *scheduler, int frame_cap)
+{
+	*scheduler = {};
+	scheduler->min_frame_seconds = (frame_cap > 0) ? 1.0 / (double)frame_cap : 0.0;
+	scheduler->is_dirty = true;
+}
+
+static void
+func MarkFrameDirty(FrameScheduler *scheduler)
+{
+	scheduler->is_dirty = true;
+}
+
+// Moving the mouse without a button down does not change the picture, pressing, releasing and dragging do.
+static bool
+func InputChangesScene(Input old_input, Input new_input)
+{
+	bool changes_buttons = (old_input.left_mouse_button_down != new_input.left_mouse_button_down) ||
+						   (old_input.right_mouse_button_down != new_input.right_mouse_button_down);
+
+	bool is_dragging = (new_input.left_mouse_button_down || new_input.right_mouse_button_down);
+	bool moves_mouse = (old_input.mouse_position.x != new_input.mouse_position.x) ||
+					   (old_input.mouse_position.y != new_input.mouse_position.y);
+
+	bool changes_scene = changes_buttons || (is_dragging && moves_mouse);
+	return changes_scene;
+}
+
+static bool
+func ShouldDrawFrame(FrameScheduler *scheduler, Input input, double seconds)
+{
+	if(InputChangesScene(scheduler->last_input, input)) scheduler->is_dirty = true;
+	scheduler->last_input = input;
+
+	bool should_draw = false;
+	if(!scheduler->is_dirty)
+	{
+		scheduler->idle_wakeup_n++;
+	}
+	else if(scheduler->drawn_frame_n > 0 && seconds - scheduler->last_frame_seconds < scheduler->min_frame_seconds)
+	{
+		scheduler->capped_wakeup_n++;
+	}
+	else
+	{
+		should_draw = true;
+		scheduler->is_dirty = false;
+		scheduler->last_frame_seconds = seconds;
+		scheduler->drawn_frame_n++;
+	}
+
+	return should_draw;
+}
+
+// How long the platform layer can sleep before the next frame is due, negative if it can wait for the next event.
+static double
+func GetFrameWaitSeconds(FrameScheduler *scheduler, double seconds)
+{
+	double wait_seconds = -1.0;
+	if(scheduler->is_dirty)
+	{
+		wait_seconds = scheduler->last_frame_seconds + scheduler->min_frame_seconds - seconds;
+		if(wait_seconds < 0.0) wait_seconds = 0.0;
+	}
+
+	return wait_seconds;
+}
@@ -0,0 +1,189 @@
+// Records everything DrawScene depends on, frame by frame, into a binary file. DrawScene does not look at
+// the clock, so playing a recording back draws exactly the frames of the recorded run, however fast or
+// slow they are drawn. Recordings start from a solved cube, only the view rotation is kept.
+// The file is a RecordingHeader followed by frame_n RecordedFrames, little endian.
+
+#define RECORDING_MAGIC 0x43525543 // "CURC"
+#define RECORDING_VERSION 2
+
+#define RECORDED_LEFT_BUTTON 1
+#define RECORDED_RIGHT_BUTTON 2
+
+struct RecordingHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	int frame_n;
+
+	int side_n;
+	float side_radius;
+	Quat rotations;
+	int depth_test;
+	unsigned int outline_color;
+};
+
+// The window can be resized and the cube rebuilt while recording, so every frame keeps the buffer size and
+// render scale, the cubies along a side and the outline thickness along with the mouse.
+struct RecordedFrame
+{
+	float mouse_x;
+	float mouse_y;
+	float render_scale;
+	unsigned short width;
+	unsigned short height;
+	unsigned char buttons;
+	unsigned char side_n;
+	unsigned char outline_thickness;
+	unsigned char padding;
+};
+
+struct InputRecording
+{
+	RecordingHeader header;
+	RecordedFrame *frames;
+	int frame_capacity;
+};
+
+static void
+func FreeInputRecording(InputRecording *recording)
+{
+	delete[] recording->frames;
+	*recording = {};
+}
+
+static void
+func StartInputRecording(InputRecording *recording, Scene *scene, Buffer *buffer)
+{
+	ResizeSceneCube(scene, scene->big_cube.side_n);
+
+	RecordingHeader *header = &recording->header;
+	header->magic = RECORDING_MAGIC;
+	header->version = RECORDING_VERSION;
+	header->frame_n = 0;
+	header->side_n = scene->big_cube.side_n;
+	header->side_radius = scene->side_radius;
+	header->rotations = scene->big_cube.rotations;
+	header->depth_test = buffer->depth_test ? 1 : 0;
+	header->outline_color = buffer->outline_color;
+}
+
+// Called with the input of every frame right before it is drawn.
+static void
+func RecordInputFrame(InputRecording *recording, Buffer *buffer, Scene *scene, Input input)
+{
+	RecordingHeader *header = &recording->header;
+	if(header->frame_n == recording->frame_capacity)
+	{
+		int new_capacity = (recording->frame_capacity > 0) ? 2 * recording->frame_capacity : 1024;
+		RecordedFrame *new_frames = new RecordedFrame[new_capacity];
+		for(int i = 0; i < header->frame_n; i++) new_frames[i] = recording->frames[i];
+
+		delete[] recording->frames;
+		recording->frames = new_frames;
+		recording->frame_capacity = new_capacity;
+	}
+
+	RecordedFrame *frame = &recording->frames[header->frame_n];
+	header->frame_n++;
+
+	*frame = {};
+	frame->mouse_x = input.mouse_position.x;
+	frame->mouse_y = input.mouse_position.y;
+	frame->render_scale = scene->render_scale;
+	frame->width = (unsigned short)buffer->width;
+	frame->height = (unsigned short)buffer->height;
+	if(input.left_mouse_button_down) frame->buttons |= RECORDED_LEFT_BUTTON;
+	if(input.right_mouse_button_down) frame->buttons |= RECORDED_RIGHT_BUTTON;
+	frame->side_n = (unsigned char)scene->big_cube.side_n;
+	frame->outline_thickness = (unsigned char)buffer->outline_thickness;
+}
+
+static bool
+func WriteInputRecording(InputRecording *recording, const char *path)
+{
+	FILE *file = fopen(path, "wb");
+	if(!file) return false;
+
+	int frame_n = recording->header.frame_n;
+	bool is_written = (fwrite(&recording->header, sizeof(recording->header), 1, file) == 1) &&
+					  ((int)fwrite(recording->frames, sizeof(RecordedFrame), frame_n, file) == frame_n);
+
+	fclose(file);
+	return is_written;
+}
+
+static bool
+func ReadInputRecording(InputRecording *recording, const char *path)
+{
+	FreeInputRecording(recording);
+
+	FILE *file = fopen(path, "rb");
+	if(!file) return false;
+
+	RecordingHeader *header = &recording->header;
+	bool is_valid = (fread(header, sizeof(*header), 1, file) == 1) &&
+					header->magic == RECORDING_MAGIC && header->version == RECORDING_VERSION &&
+					header->frame_n > 0 &&
+					header->side_n >= MIN_CUBE_SIDE_N && header->side_n <= MAX_CUBE_SIDE_N &&
+					header->side_radius > 0.0f;
+	if(is_valid)
+	{
+		recording->frames = new RecordedFrame[header->frame_n];
+		recording->frame_capacity = header->frame_n;
+		is_valid = ((int)fread(recording->frames, sizeof(RecordedFrame), header->frame_n, file) == header->frame_n);
+	}
+
+	for(int i = 0; is_valid && i < header->frame_n; i++)
+	{
+		RecordedFrame *frame = &recording->frames[i];
+		is_valid = (frame->render_scale > 0.0f && frame->render_scale <= 1.0f &&
+					frame->side_n >= MIN_CUBE_SIDE_N && frame->side_n <= MAX_CUBE_SIDE_N &&
+					frame->outline_thickness <= MAX_OUTLINE_THICKNESS);
+	}
+
+	fclose(file);
+	if(!is_valid) FreeInputRecording(recording);
+	return is_valid;
+}
+
+// Puts the scene and the buffer into the state the recording started from.
+static void
+func StartInputReplay(InputRecording *recording, Scene *scene, Buffer *buffer)
+{
+	RecordingHeader *header = &recording->header;
+
+	scene->side_radius = header->side_radius;
+	ResizeSceneCube(scene, header->side_n);
+	scene->big_cube.rotations = header->rotations;
+
+	bool depth_test = (header->depth_test != 0);
+	if(buffer->depth_test != depth_test) SetBufferDepthTest(buffer, depth_test);
+}
+
+// Applies the recorded buffer size, render scale, cube size and outline of the frame and returns its input.
+static Input
+func GetReplayInput(InputRecording *recording, int frame_index, Scene *scene, Buffer *buffer)
+{
+	Assert(frame_index >= 0 && frame_index < recording->header.frame_n);
+	RecordedFrame *frame = &recording->frames[frame_index];
+
+	if(buffer->width != frame->width || buffer->height != frame->height)
+	{
+		ResizeBuffer(buffer, frame->width, frame->height);
+	}
+
+	scene->render_scale = frame->render_scale;
+
+	if(scene->big_cube.side_n != frame->side_n) ResizeSceneCube(scene, frame->side_n);
+
+	if(buffer->outline_thickness != frame->outline_thickness || buffer->outline_color != recording->header.outline_color)
+	{
+		SetBufferOutline(buffer, frame->outline_thickness, recording->header.outline_color);
+	}
+
+	Input input = {};
+	input.mouse_position = Point2(frame->mouse_x, frame->mouse_y);
+	input.left_mouse_button_down = ((frame->buttons & RECORDED_LEFT_BUTTON) != 0);
+	input.right_mouse_button_down = ((frame->buttons & RECORDED_RIGHT_BUTTON) != 0);
+	return input;
+}
@@ -1,3 +1,80 @@
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define SIMD_X86 0
+#endif
+
+// MSVC lets any function use AVX2 intrinsics, GCC and Clang need the function to be marked.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SIMD_TARGET_AVX2
+#else
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+enum SimdLevel
+{
+	SIMD_NONE,
+	SIMD_SSE2,
+	SIMD_AVX2
+};
+
+static int global_simd_level = -1;
+
+static int
+func DetectSimdLevel()
+{
+	int level = SIMD_NONE;
+
+#if SIMD_X86
+#if defined(_MSC_VER)
+	int info[4] = {};
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+
+	__cpuid(info, 1);
+	bool has_sse2 = (info[3] & (1 << 26)) != 0;
+	bool has_osxsave = (info[2] & (1 << 27)) != 0;
+	bool has_avx = (info[2] & (1 << 28)) != 0;
+
+	bool has_avx2 = false;
+	if(max_leaf >= 7 && has_osxsave && has_avx && (_xgetbv(0) & 6) == 6)
+	{
+		__cpuidex(info, 7, 0);
+		has_avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	bool has_sse2 = __builtin_cpu_supports("sse2");
+	bool has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+	if(has_sse2) level = SIMD_SSE2;
+	if(has_avx2) level = SIMD_AVX2;
+#endif
+
+	return level;
+}
+
+static int
+func GetSimdLevel()
+{
+	if(global_simd_level < 0) global_simd_level = DetectSimdLevel();
+	return global_simd_level;
+}
+
+// Used to compare the kernels against each other, a level above what the CPU supports is clamped.
+static void
+func LimitSimdLevel(int max_level)
+{
+	int level = DetectSimdLevel();
+	if(level > max_level) level = max_level;
+	global_simd_level = level;
+}
+
 struct V2
 {
 	float x, y;
@@ -250,7 +327,7 @@ func GetRotationAroundAxis(V3 axis, float theta)
 	else if(axis.z == -1.0f) rotation = GetZAxisRotation(-theta);
 	else
 	{
-		DebugBreak();
+		Assert(false);
 	}
 
 	return rotation;
@@ -395,4 +472,170 @@ func GetRotationQuat(V3 axis, float angle)
 	q.y = s * axis.y;
 	q.z = s * axis.z;
 	return q;
+}
+
+// Same rotation as QuatRotate for a unit quaternion, cheaper when many points turn by the same rotation.
+static M3x3
+func QuatToMatrix(Quat q)
+{
+	float xx = q.x * q.x;
+	float yy = q.y * q.y;
+	float zz = q.z * q.z;
+	float xy = q.x * q.y;
+	float xz = q.x * q.z;
+	float yz = q.y * q.z;
+	float wx = q.w * q.x;
+	float wy = q.w * q.y;
+	float wz = q.w * q.z;
+
+	M3x3 m =
+	{
+		{
+			{1.0f - 2.0f * (yy + zz),        2.0f * (xy - wz),        2.0f * (xz + wy)},
+			{       2.0f * (xy + wz), 1.0f - 2.0f * (xx + zz),        2.0f * (yz - wx)},
+			{       2.0f * (xz - wy),        2.0f * (yz + wx), 1.0f - 2.0f * (xx + yy)}
+		}
+	};
+
+	return m;
+}
+
+// Points kept as one array per coordinate, so the batched transforms below load several points into one register.
+struct V3Array
+{
+	float *x;
+	float *y;
+	float *z;
+};
+
+static V3
+func GetArrayPoint(V3Array points, int i)
+{
+	V3 p = Point3(points.x[i], points.y[i], points.z[i]);
+	return p;
+}
+
+static void
+func SetArrayPoint(V3Array points, int i, V3 p)
+{
+	points.x[i] = p.x;
+	points.y[i] = p.y;
+	points.z[i] = p.z;
+}
+
+static void
+func TransformPoint(M3x3 m, V3 offset, V3Array points, V3Array result, int i)
+{
+	V3 r = offset + m * GetArrayPoint(points, i);
+	SetArrayPoint(result, i, r);
+}
+
+// result[i] = offset + m * points[i], result may be the same arrays as points.
+// The reference for the SIMD versions, all three round the same way and give the same results.
+static void
+func TransformPointsScalar(M3x3 m, V3 offset, V3Array points, V3Array result, int point_n)
+{
+	for(int i = 0; i < point_n; i++)
+	{
+		TransformPoint(m, offset, points, result, i);
+	}
+}
+
+#if SIMD_X86
+static void
+func TransformPointsSse2(M3x3 m, V3 offset, V3Array points, V3Array result, int point_n)
+{
+	__m128 m00 = _mm_set1_ps(m.v[0][0]), m01 = _mm_set1_ps(m.v[0][1]), m02 = _mm_set1_ps(m.v[0][2]);
+	__m128 m10 = _mm_set1_ps(m.v[1][0]), m11 = _mm_set1_ps(m.v[1][1]), m12 = _mm_set1_ps(m.v[1][2]);
+	__m128 m20 = _mm_set1_ps(m.v[2][0]), m21 = _mm_set1_ps(m.v[2][1]), m22 = _mm_set1_ps(m.v[2][2]);
+	__m128 offset_x = _mm_set1_ps(offset.x);
+	__m128 offset_y = _mm_set1_ps(offset.y);
+	__m128 offset_z = _mm_set1_ps(offset.z);
+
+	int i = 0;
+	for(; i + 4 <= point_n; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(points.x + i);
+		__m128 y = _mm_loadu_ps(points.y + i);
+		__m128 z = _mm_loadu_ps(points.z + i);
+
+		__m128 rx = _mm_add_ps(offset_x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m01, y)), _mm_mul_ps(m02, z)));
+		__m128 ry = _mm_add_ps(offset_y, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, x), _mm_mul_ps(m11, y)), _mm_mul_ps(m12, z)));
+		__m128 rz = _mm_add_ps(offset_z, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, x), _mm_mul_ps(m21, y)), _mm_mul_ps(m22, z)));
+
+		_mm_storeu_ps(result.x + i, rx);
+		_mm_storeu_ps(result.y + i, ry);
+		_mm_storeu_ps(result.z + i, rz);
+	}
+
+	for(; i < point_n; i++)
+	{
+		TransformPoint(m, offset, points, result, i);
+	}
+}
+
+// Multiplies and adds stay separate instead of FMA, so every lane rounds like the scalar version.
+static SIMD_TARGET_AVX2 void
+func TransformPointsAvx2(M3x3 m, V3 offset, V3Array points, V3Array result, int point_n)
+{
+	__m256 m00 = _mm256_set1_ps(m.v[0][0]), m01 = _mm256_set1_ps(m.v[0][1]), m02 = _mm256_set1_ps(m.v[0][2]);
+	__m256 m10 = _mm256_set1_ps(m.v[1][0]), m11 = _mm256_set1_ps(m.v[1][1]), m12 = _mm256_set1_ps(m.v[1][2]);
+	__m256 m20 = _mm256_set1_ps(m.v[2][0]), m21 = _mm256_set1_ps(m.v[2][1]), m22 = _mm256_set1_ps(m.v[2][2]);
+	__m256 offset_x = _mm256_set1_ps(offset.x);
+	__m256 offset_y = _mm256_set1_ps(offset.y);
+	__m256 offset_z = _mm256_set1_ps(offset.z);
+
+	int i = 0;
+	for(; i + 8 <= point_n; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(points.x + i);
+		__m256 y = _mm256_loadu_ps(points.y + i);
+		__m256 z = _mm256_loadu_ps(points.z + i);
+
+		__m256 rx = _mm256_add_ps(offset_x, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m00, x), _mm256_mul_ps(m01, y)), _mm256_mul_ps(m02, z)));
+		__m256 ry = _mm256_add_ps(offset_y, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m10, x), _mm256_mul_ps(m11, y)), _mm256_mul_ps(m12, z)));
+		__m256 rz = _mm256_add_ps(offset_z, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m20, x), _mm256_mul_ps(m21, y)), _mm256_mul_ps(m22, z)));
+
+		_mm256_storeu_ps(result.x + i, rx);
+		_mm256_storeu_ps(result.y + i, ry);
+		_mm256_storeu_ps(result.z + i, rz);
+	}
+
+	for(; i < point_n; i++)
+	{
+		TransformPoint(m, offset, points, result, i);
+	}
+}
+#endif
+
+static void
+func TransformPoints(M3x3 m, V3 offset, V3Array points, V3Array result, int point_n)
+{
+	switch(GetSimdLevel())
+	{
+#if SIMD_X86
+		case SIMD_AVX2:
+		{
+			TransformPointsAvx2(m, offset, points, result, point_n);
+			break;
+		}
+		case SIMD_SSE2:
+		{
+			TransformPointsSse2(m, offset, points, result, point_n);
+			break;
+		}
+#endif
+		default:
+		{
+			TransformPointsScalar(m, offset, points, result, point_n);
+			break;
+		}
+	}
+}
+
+// result[i] = offset + QuatRotate(rotations, points[i]), with one matrix instead of two quaternion products per point.
+static void
+func RotatePoints(Quat rotations, V3 offset, V3Array points, V3Array result, int point_n)
+{
+	TransformPoints(QuatToMatrix(rotations), offset, points, result, point_n);
 }
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include <stddef.h>
+
+#define ARENA_ALIGNMENT 64
+
+// One block of memory handed out front to back. Nothing pushed on it is freed on its own,
+// resetting the arena drops everything at once.
+struct MemArena
+{
+	char *memory;
+	size_t max_size;
+	size_t used_size;
+};
+
+static void
+func FreeArena(MemArena *arena)
+{
+	delete[] arena->memory;
+	*arena = {};
+}
+
+static void
+func ResetArena(MemArena *arena)
+{
+	arena->used_size = 0;
+}
+
+// Makes sure size bytes fit after a reset, the old block is only replaced when it is too small.
+static void
+func ReserveArena(MemArena *arena, size_t size)
+{
+	ResetArena(arena);
+
+	size_t max_size = size + ARENA_ALIGNMENT;
+	if(arena->max_size < max_size)
+	{
+		FreeArena(arena);
+		arena->memory = new char[max_size];
+		arena->max_size = max_size;
+	}
+}
+
+static void *
+func ArenaPushData(MemArena *arena, size_t size)
+{
+	size_t address = (size_t)(arena->memory + arena->used_size);
+	size_t padding = (ARENA_ALIGNMENT - (address % ARENA_ALIGNMENT)) % ARENA_ALIGNMENT;
+
+	Assert(arena->used_size + padding + size <= arena->max_size);
+
+	void *data = arena->memory + arena->used_size + padding;
+	arena->used_size += padding + size;
+	return data;
+}
+
+#define ArenaPushArray(arena, count, type) ((type *)ArenaPushData((arena), (count) * sizeof(type)))
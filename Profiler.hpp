@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+
+#if SIMD_X86 && !defined(_MSC_VER)
+#include <x86intrin.h>
+#endif
+
+// The profiler is on unless the build defines PROFILER_ENABLED as 0, then every PROFILE_ macro is empty.
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+// Stages that run on the tile workers add up the time of every worker, the others are wall time
+// on the main thread.
+enum ProfileStage
+{
+	PROFILE_CENTERS,
+	PROFILE_SORT,
+	PROFILE_PUSH,
+	PROFILE_BIN,
+	PROFILE_CLEAR,
+	PROFILE_FACES,
+	PROFILE_EDGES,
+	PROFILE_RESOLVE,
+	PROFILE_PICK,
+	PROFILE_PRESENT,
+	PROFILE_STAGE_N,
+
+	// There are hundreds of tiles and faces and edges take turns inside a tile, reading the clock for all
+	// of them would cost more than the profile is worth. The workers only time all of their tiles together,
+	// and every PROFILE_TILE_SAMPLE_N-th tile times its clear, faces and edges. The tile time is split
+	// between those stages the way it was on the sampled tiles.
+	PROFILE_TILE_WORK = PROFILE_STAGE_N,
+	PROFILE_SAMPLED_CLEAR,
+	PROFILE_SAMPLED_FACES,
+	PROFILE_SAMPLED_EDGES,
+	PROFILE_TIMER_N
+};
+
+enum ProfileCounter
+{
+	PROFILE_QUADS,
+	PROFILE_PIXELS,
+	// Cubies with no face towards the viewer.
+	PROFILE_CULLED_CUBES,
+	PROFILE_COUNTER_N
+};
+
+const char *profile_stage_names[PROFILE_STAGE_N] =
+{
+	"centers",
+	"sort",
+	"push",
+	"bin",
+	"clear",
+	"faces",
+	"edges",
+	"resolve",
+	"pick",
+	"present"
+};
+
+const char *profile_counter_names[PROFILE_COUNTER_N] =
+{
+	"quads",
+	"pixels",
+	"culled"
+};
+
+#if PROFILER_ENABLED
+
+#define PROFILE_FRAME_N 256
+#define PROFILE_TILE_SAMPLE_N 16
+
+struct ProfileFrame
+{
+	double frame_ms;
+	double stage_ms[PROFILE_STAGE_N];
+	long long counters[PROFILE_COUNTER_N];
+};
+
+// Every thread adds up its times and counts without synchronization and flushes them into the profiler
+// when it is done with a batch of work.
+struct ProfileThread
+{
+	long long stage_ticks[PROFILE_TIMER_N];
+	long long counters[PROFILE_COUNTER_N];
+};
+
+// Keeps the last PROFILE_FRAME_N frames, frame_n counts every frame so far.
+struct Profiler
+{
+	std::atomic<long long> stage_ticks[PROFILE_TIMER_N];
+	std::atomic<long long> counters[PROFILE_COUNTER_N];
+
+	long long frame_start_ticks;
+	double frame_start_seconds;
+
+	// Ticks are turned into time with the rate measured over all profiled frames.
+	long long total_ticks;
+	double total_seconds;
+
+	ProfileFrame frames[PROFILE_FRAME_N];
+	long long frame_n;
+};
+
+static Profiler global_profiler;
+static thread_local ProfileThread global_profile_thread;
+
+// The time stamp counter is read in a few cycles, the rate it runs at is measured against the steady clock.
+static long long
+func GetProfileTicks()
+{
+#if SIMD_X86
+	long long ticks = (long long)__rdtsc();
+#else
+	long long ticks = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	return ticks;
+}
+
+static double
+func GetProfileSeconds()
+{
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	return seconds;
+}
+
+static void
+func FlushProfileThread()
+{
+	ProfileThread *thread = &global_profile_thread;
+	for(int stage = 0; stage < PROFILE_TIMER_N; stage++)
+	{
+		if(thread->stage_ticks[stage] != 0) global_profiler.stage_ticks[stage] += thread->stage_ticks[stage];
+		thread->stage_ticks[stage] = 0;
+	}
+	for(int counter = 0; counter < PROFILE_COUNTER_N; counter++)
+	{
+		if(thread->counters[counter] != 0) global_profiler.counters[counter] += thread->counters[counter];
+		thread->counters[counter] = 0;
+	}
+}
+
+// Drops the recorded frames, the measured tick rate is kept.
+static void
+func ResetProfiler()
+{
+	global_profiler.frame_n = 0;
+}
+
+static void
+func BeginProfileFrame()
+{
+	FlushProfileThread();
+	for(int stage = 0; stage < PROFILE_TIMER_N; stage++) global_profiler.stage_ticks[stage] = 0;
+	for(int counter = 0; counter < PROFILE_COUNTER_N; counter++) global_profiler.counters[counter] = 0;
+
+	global_profiler.frame_start_seconds = GetProfileSeconds();
+	global_profiler.frame_start_ticks = GetProfileTicks();
+}
+
+static void
+func EndProfileFrame()
+{
+	long long end_ticks = GetProfileTicks();
+	double end_seconds = GetProfileSeconds();
+	FlushProfileThread();
+
+	global_profiler.total_ticks += end_ticks - global_profiler.frame_start_ticks;
+	global_profiler.total_seconds += end_seconds - global_profiler.frame_start_seconds;
+	double ms_per_tick = (global_profiler.total_ticks > 0) ?
+						 1000.0 * global_profiler.total_seconds / (double)global_profiler.total_ticks : 0.0;
+
+	ProfileFrame *frame = &global_profiler.frames[global_profiler.frame_n % PROFILE_FRAME_N];
+	frame->frame_ms = 1000.0 * (end_seconds - global_profiler.frame_start_seconds);
+	for(int stage = 0; stage < PROFILE_STAGE_N; stage++)
+	{
+		frame->stage_ms[stage] = ms_per_tick * (double)global_profiler.stage_ticks[stage];
+	}
+
+	double sampled_clear = (double)global_profiler.stage_ticks[PROFILE_SAMPLED_CLEAR];
+	double sampled_faces = (double)global_profiler.stage_ticks[PROFILE_SAMPLED_FACES];
+	double sampled_edges = (double)global_profiler.stage_ticks[PROFILE_SAMPLED_EDGES];
+	double sampled_total = sampled_clear + sampled_faces + sampled_edges;
+	if(sampled_total > 0.0)
+	{
+		double tile_ms = ms_per_tick * (double)global_profiler.stage_ticks[PROFILE_TILE_WORK];
+		frame->stage_ms[PROFILE_CLEAR] += tile_ms * sampled_clear / sampled_total;
+		frame->stage_ms[PROFILE_FACES] += tile_ms * sampled_faces / sampled_total;
+		frame->stage_ms[PROFILE_EDGES] += tile_ms * sampled_edges / sampled_total;
+	}
+	for(int counter = 0; counter < PROFILE_COUNTER_N; counter++)
+	{
+		frame->counters[counter] = global_profiler.counters[counter];
+	}
+
+	global_profiler.frame_n++;
+}
+
+// Times the rest of the enclosing block.
+struct ProfileScope
+{
+	int stage;
+	long long start_ticks;
+
+	ProfileScope(int stage) : stage(stage), start_ticks(GetProfileTicks()) {}
+	~ProfileScope() { global_profile_thread.stage_ticks[stage] += GetProfileTicks() - start_ticks; }
+};
+
+// Times work that switches between stages, the clock is only read when the stage changes.
+struct ProfileStageRun
+{
+	bool is_on;
+	int stage;
+	long long start_ticks;
+};
+
+// A different scattered set of tiles every frame, tiles next to each other mostly show the same thing.
+static bool
+func IsProfileSampleTile(int tile)
+{
+	unsigned int hash = (unsigned int)(tile + global_profiler.frame_n) * 2654435761u;
+	bool is_sample = ((hash >> 16) % PROFILE_TILE_SAMPLE_N == 0);
+	return is_sample;
+}
+
+static void
+func SwitchProfileStage(ProfileStageRun *run, int stage)
+{
+	if(run->is_on && stage != run->stage)
+	{
+		long long ticks = GetProfileTicks();
+		if(run->stage >= 0) global_profile_thread.stage_ticks[run->stage] += ticks - run->start_ticks;
+
+		run->stage = stage;
+		run->start_ticks = ticks;
+	}
+}
+
+#define PROFILE_JOIN_(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN_(a, b)
+
+#define PROFILE_BEGIN_FRAME() BeginProfileFrame()
+#define PROFILE_END_FRAME() EndProfileFrame()
+#define PROFILE_SCOPE(stage) ProfileScope PROFILE_JOIN(profile_scope_, __LINE__)(stage)
+#define PROFILE_SAMPLED_RUN_BEGIN(run, tile) ProfileStageRun run = {IsProfileSampleTile(tile), -1, 0}
+#define PROFILE_RUN_SWITCH(run, stage) SwitchProfileStage(&run, stage)
+#define PROFILE_RUN_END(run) SwitchProfileStage(&run, -1)
+#define PROFILE_COUNT(counter, n) (global_profile_thread.counters[counter] += (n))
+#define PROFILE_FLUSH_THREAD() FlushProfileThread()
+
+// Oldest frame first, one row per frame.
+static bool
+func WriteProfileCsv(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if(!file) return false;
+
+	fprintf(file, "frame,frame_ms");
+	for(int stage = 0; stage < PROFILE_STAGE_N; stage++) fprintf(file, ",%s_ms", profile_stage_names[stage]);
+	for(int counter = 0; counter < PROFILE_COUNTER_N; counter++) fprintf(file, ",%s", profile_counter_names[counter]);
+	fprintf(file, "\n");
+
+	long long first_frame = global_profiler.frame_n - PROFILE_FRAME_N;
+	if(first_frame < 0) first_frame = 0;
+	for(long long frame_id = first_frame; frame_id < global_profiler.frame_n; frame_id++)
+	{
+		ProfileFrame *frame = &global_profiler.frames[frame_id % PROFILE_FRAME_N];
+		fprintf(file, "%lld,%.4f", frame_id, frame->frame_ms);
+		for(int stage = 0; stage < PROFILE_STAGE_N; stage++) fprintf(file, ",%.4f", frame->stage_ms[stage]);
+		for(int counter = 0; counter < PROFILE_COUNTER_N; counter++) fprintf(file, ",%lld", frame->counters[counter]);
+		fprintf(file, "\n");
+	}
+
+	fclose(file);
+	return true;
+}
+
+// 3x5 pixel glyphs, bit 14 is the top left pixel and every row takes 3 bits.
+static unsigned short profile_font_glyphs[] =
+{
+	0x7B6F, 0x2C97, 0x73E7, 0x72CF, 0x5BC9, 0x79CF, 0x79EF, 0x7252, 0x7BEF, 0x7BCF, // 0-9
+	0x2BED, 0x6BAE, 0x3923, 0x6B6E, 0x79A7, 0x79A4, 0x396B, 0x5BED, 0x7497, 0x126A, // A-J
+	0x5BAD, 0x4927, 0x5FED, 0x6B6D, 0x2B6A, 0x6BA4, 0x2B7B, 0x6BAD, 0x388E, 0x7492, // K-T
+	0x5B6F, 0x5B6A, 0x5BFD, 0x5AAD, 0x5A92, 0x72A7,                                 // U-Z
+	0x0002, 0x0410, 0x01C0                                                          // . : -
+};
+
+static int
+func GetProfileGlyph(char c)
+{
+	if(c >= 'a' && c <= 'z') c = c - 'a' + 'A';
+
+	int glyph = 0;
+	if(c >= '0' && c <= '9') glyph = profile_font_glyphs[c - '0'];
+	else if(c >= 'A' && c <= 'Z') glyph = profile_font_glyphs[10 + c - 'A'];
+	else if(c == '.') glyph = profile_font_glyphs[36];
+	else if(c == ':') glyph = profile_font_glyphs[37];
+	else if(c == '-') glyph = profile_font_glyphs[38];
+	return glyph;
+}
+
+#define PROFILE_FONT_SCALE 2
+#define PROFILE_LINE_HEIGHT (7 * PROFILE_FONT_SCALE)
+#define PROFILE_CHAR_WIDTH (4 * PROFILE_FONT_SCALE)
+
+// The overlay draws straight into the pixels of a buffer with rows going up the screen, pitch pixels apart.
+// top_row is the highest row the text covers.
+static void
+func DrawProfileText(unsigned int *colors, int width, int height, int pitch, int top_row, int left_col,
+					 const char *text, unsigned int color)
+{
+	for(int char_id = 0; text[char_id]; char_id++)
+	{
+		int glyph = GetProfileGlyph(text[char_id]);
+		int glyph_col = left_col + char_id * PROFILE_CHAR_WIDTH;
+		for(int glyph_y = 0; glyph_y < 5 * PROFILE_FONT_SCALE; glyph_y++)
+		{
+			int row = top_row - glyph_y;
+			if(row < 0 || row >= height) continue;
+
+			int bits = glyph >> (3 * (4 - glyph_y / PROFILE_FONT_SCALE));
+			for(int glyph_x = 0; glyph_x < 3 * PROFILE_FONT_SCALE; glyph_x++)
+			{
+				int col = glyph_col + glyph_x;
+				if(col < 0 || col >= width) continue;
+
+				if(bits & (4 >> (glyph_x / PROFILE_FONT_SCALE))) colors[row * pitch + col] = color;
+			}
+		}
+	}
+}
+
+// Averages of the last frames in the top left corner, drawn over the finished frame before it is presented.
+static void
+func DrawProfileOverlay(unsigned int *colors, int width, int height, int pitch)
+{
+	int average_frame_n = (global_profiler.frame_n < 64) ? (int)global_profiler.frame_n : 64;
+	if(average_frame_n == 0) return;
+
+	ProfileFrame average = {};
+	for(int i = 1; i <= average_frame_n; i++)
+	{
+		ProfileFrame *frame = &global_profiler.frames[(global_profiler.frame_n - i) % PROFILE_FRAME_N];
+		average.frame_ms += frame->frame_ms;
+		for(int stage = 0; stage < PROFILE_STAGE_N; stage++) average.stage_ms[stage] += frame->stage_ms[stage];
+		for(int counter = 0; counter < PROFILE_COUNTER_N; counter++) average.counters[counter] += frame->counters[counter];
+	}
+
+	char lines[1 + PROFILE_STAGE_N + PROFILE_COUNTER_N][64] = {};
+	int line_n = 0;
+	snprintf(lines[line_n++], sizeof(lines[0]), "frame %8.3f ms", average.frame_ms / average_frame_n);
+	for(int stage = 0; stage < PROFILE_STAGE_N; stage++)
+	{
+		snprintf(lines[line_n++], sizeof(lines[0]), "%-7s %8.3f ms", profile_stage_names[stage],
+				 average.stage_ms[stage] / average_frame_n);
+	}
+	for(int counter = 0; counter < PROFILE_COUNTER_N; counter++)
+	{
+		snprintf(lines[line_n++], sizeof(lines[0]), "%-7s %8lld", profile_counter_names[counter],
+				 average.counters[counter] / average_frame_n);
+	}
+
+	int margin = 4;
+	int backing_width = 2 * margin + 20 * PROFILE_CHAR_WIDTH;
+	int backing_height = 2 * margin + line_n * PROFILE_LINE_HEIGHT;
+	if(backing_width > width) backing_width = width;
+	if(backing_height > height) backing_height = height;
+
+	for(int row = height - backing_height; row < height; row++)
+	{
+		for(int col = 0; col < backing_width; col++)
+		{
+			colors[row * pitch + col] = 0x202020;
+		}
+	}
+
+	for(int line_id = 0; line_id < line_n; line_id++)
+	{
+		int top_row = height - 1 - margin - line_id * PROFILE_LINE_HEIGHT;
+		DrawProfileText(colors, width, height, pitch, top_row, margin, lines[line_id], 0xFFFFFF);
+	}
+}
+
+#else
+
+#define PROFILE_BEGIN_FRAME()
+#define PROFILE_END_FRAME()
+#define PROFILE_SCOPE(stage)
+#define PROFILE_SAMPLED_RUN_BEGIN(run, tile)
+#define PROFILE_RUN_SWITCH(run, stage)
+#define PROFILE_RUN_END(run)
+#define PROFILE_COUNT(counter, n)
+#define PROFILE_FLUSH_THREAD()
+
+#endif
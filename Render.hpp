@@ -0,0 +1,1322 @@
+#include <float.h>
+#include <string.h>
+
+// Larger z is closer to the viewer. With depth_test on, depths holds the z of the closest quad drawn so far
+// and only pixels in front of it are written.
+#define DEPTH_CLEAR_VALUE (-FLT_MAX)
+
+// Pixel (row, col) is at index row * pitch + col. Every row starts on an ARENA_ALIGNMENT boundary,
+// so the pitch can be a bit larger than the width.
+struct Buffer
+{
+	MemArena memory;
+	unsigned int *colors;
+	unsigned int *cube_face_ids;
+	float *depths;
+	int width;
+	int height;
+	int pitch;
+
+	bool depth_test;
+
+	// Picking does not need the face ids, they are only kept in cube_face_ids if this is set.
+	bool store_cube_face_ids;
+
+	// With outline_thickness > 0, edges are found from the face ids after all faces are drawn
+	// instead of being drawn as lines, see DrawOutlines.
+	int outline_thickness;
+	unsigned int outline_color;
+
+	// Counts the calls to ResizeBuffer, anything that remembers what the pixels hold checks it.
+	int resize_n;
+
+	// With use_palette set, drawing writes palette indices into color_indices, a byte per pixel. Whoever draws
+	// knows the palette and expands the indices into colors with ResolveRect, see TileRenderer.
+	bool use_palette;
+	unsigned char *color_indices;
+};
+
+// Inclusive pixel bounds, rendering into a tile never touches pixels outside of its rectangle.
+// A rect with min > max is empty.
+struct ClipRect
+{
+	int min_col, max_col;
+	int min_row, max_row;
+};
+
+static ClipRect
+func GetEmptyRect()
+{
+	ClipRect rect = {};
+	rect.max_col = -1;
+	rect.max_row = -1;
+	return rect;
+}
+
+static bool
+func IsRectEmpty(ClipRect rect)
+{
+	bool is_empty = (rect.min_col > rect.max_col || rect.min_row > rect.max_row);
+	return is_empty;
+}
+
+// The smallest rect containing both.
+static ClipRect
+func UniteRects(ClipRect a, ClipRect b)
+{
+	if(IsRectEmpty(a)) return b;
+	if(IsRectEmpty(b)) return a;
+
+	ClipRect rect = {};
+	rect.min_col = (a.min_col < b.min_col) ? a.min_col : b.min_col;
+	rect.max_col = (a.max_col > b.max_col) ? a.max_col : b.max_col;
+	rect.min_row = (a.min_row < b.min_row) ? a.min_row : b.min_row;
+	rect.max_row = (a.max_row > b.max_row) ? a.max_row : b.max_row;
+	return rect;
+}
+
+static ClipRect
+func IntersectRects(ClipRect a, ClipRect b)
+{
+	ClipRect rect = {};
+	rect.min_col = (a.min_col > b.min_col) ? a.min_col : b.min_col;
+	rect.max_col = (a.max_col < b.max_col) ? a.max_col : b.max_col;
+	rect.min_row = (a.min_row > b.min_row) ? a.min_row : b.min_row;
+	rect.max_row = (a.max_row < b.max_row) ? a.max_row : b.max_row;
+	if(IsRectEmpty(rect)) rect = GetEmptyRect();
+	return rect;
+}
+
+static int
+func GetRectPixelN(ClipRect rect)
+{
+	int pixel_n = IsRectEmpty(rect) ? 0 : (rect.max_col - rect.min_col + 1) * (rect.max_row - rect.min_row + 1);
+	return pixel_n;
+}
+
+static ClipRect
+func GetBufferRect(Buffer *buffer)
+{
+	ClipRect rect = {};
+	rect.min_col = 0;
+	rect.max_col = buffer->width - 1;
+	rect.min_row = 0;
+	rect.max_row = buffer->height - 1;
+	return rect;
+}
+
+static void
+func FillRowScalar(unsigned int *values, int value_n, unsigned int value)
+{
+	for(int i = 0; i < value_n; i++)
+	{
+		values[i] = value;
+	}
+}
+
+#if SIMD_X86
+
+// Streaming stores go around the cache. That pays off for pixels that are not read again before the frame
+// is presented, a clear followed by drawing into the same pixels is faster with normal stores.
+static void
+func FillRowSse2(unsigned int *values, int value_n, unsigned int value, bool streaming)
+{
+	int head_n = (int)(((16 - ((size_t)values % 16)) % 16) / sizeof(unsigned int));
+	if(head_n > value_n) head_n = value_n;
+	FillRowScalar(values, head_n, value);
+
+	__m128i value_4 = _mm_set1_epi32((int)value);
+	int i = head_n;
+	if(streaming)
+	{
+		for(; i + 4 <= value_n; i += 4) _mm_stream_si128((__m128i *)(values + i), value_4);
+	}
+	else
+	{
+		for(; i + 4 <= value_n; i += 4) _mm_store_si128((__m128i *)(values + i), value_4);
+	}
+
+	FillRowScalar(values + i, value_n - i, value);
+}
+
+static SIMD_TARGET_AVX2 void
+func FillRowAvx2(unsigned int *values, int value_n, unsigned int value, bool streaming)
+{
+	int head_n = (int)(((32 - ((size_t)values % 32)) % 32) / sizeof(unsigned int));
+	if(head_n > value_n) head_n = value_n;
+	FillRowScalar(values, head_n, value);
+
+	__m256i value_8 = _mm256_set1_epi32((int)value);
+	int i = head_n;
+	if(streaming)
+	{
+		for(; i + 8 <= value_n; i += 8) _mm256_stream_si256((__m256i *)(values + i), value_8);
+	}
+	else
+	{
+		for(; i + 8 <= value_n; i += 8) _mm256_store_si256((__m256i *)(values + i), value_8);
+	}
+
+	FillRowScalar(values + i, value_n - i, value);
+}
+
+#endif
+
+static void
+func FillRow(int simd_level, unsigned int *values, int value_n, unsigned int value, bool streaming)
+{
+	switch(simd_level)
+	{
+#if SIMD_X86
+		case SIMD_AVX2:
+		{
+			FillRowAvx2(values, value_n, value, streaming);
+			break;
+		}
+		case SIMD_SSE2:
+		{
+			FillRowSse2(values, value_n, value, streaming);
+			break;
+		}
+#endif
+		default:
+		{
+			FillRowScalar(values, value_n, value);
+			break;
+		}
+	}
+}
+
+// Set streaming if the rect is not drawn into right after the clear, see FillRowSse2. With a palette,
+// color is the palette index.
+static void
+func ClearRect(Buffer *buffer, ClipRect clip, unsigned int color, unsigned int cube_face_id, bool streaming)
+{
+	int simd_level = GetSimdLevel();
+	int col_n = clip.max_col - clip.min_col + 1;
+
+	float depth_clear_value = DEPTH_CLEAR_VALUE;
+	unsigned int depth_clear_bits = 0;
+	memcpy(&depth_clear_bits, &depth_clear_value, sizeof(depth_clear_bits));
+
+	for(int row = clip.min_row; row <= clip.max_row; row++)
+	{
+		int offset = row * buffer->pitch + clip.min_col;
+		if(buffer->use_palette) memset(buffer->color_indices + offset, (int)color, col_n);
+		else FillRow(simd_level, buffer->colors + offset, col_n, color, streaming);
+
+		if(buffer->store_cube_face_ids)
+		{
+			FillRow(simd_level, buffer->cube_face_ids + offset, col_n, cube_face_id, streaming);
+		}
+
+		if(buffer->depth_test)
+		{
+			FillRow(simd_level, (unsigned int *)(buffer->depths + offset), col_n, depth_clear_bits, streaming);
+		}
+	}
+
+#if SIMD_X86
+	// Streaming stores are not ordered with other stores, they have to be done before another thread reads them.
+	if(streaming && simd_level != SIMD_NONE) _mm_sfence();
+#endif
+}
+
+// Copies the pixels of a rectangle from a buffer of the same size and layout.
+static void
+func CopyRect(Buffer *buffer, Buffer *source, ClipRect clip)
+{
+	Assert(buffer->width == source->width && buffer->height == source->height);
+	Assert(!buffer->depth_test || source->depth_test);
+	Assert(!buffer->store_cube_face_ids || source->store_cube_face_ids);
+	Assert(buffer->use_palette == source->use_palette);
+
+	int col_n = clip.max_col - clip.min_col + 1;
+	for(int row = clip.min_row; row <= clip.max_row; row++)
+	{
+		int offset = row * buffer->pitch + clip.min_col;
+		if(buffer->use_palette)
+		{
+			memcpy(buffer->color_indices + offset, source->color_indices + offset, col_n * sizeof(buffer->color_indices[0]));
+		}
+		else
+		{
+			memcpy(buffer->colors + offset, source->colors + offset, col_n * sizeof(buffer->colors[0]));
+		}
+
+		if(buffer->store_cube_face_ids)
+		{
+			memcpy(buffer->cube_face_ids + offset, source->cube_face_ids + offset, col_n * sizeof(buffer->cube_face_ids[0]));
+		}
+
+		if(buffer->depth_test)
+		{
+			memcpy(buffer->depths + offset, source->depths + offset, col_n * sizeof(buffer->depths[0]));
+		}
+	}
+}
+
+// The pixels are not kept. Shrinking reuses the memory the buffer already has, growing past it
+// allocates a quarter more than needed so the next few steps of a drag resize fit as well.
+static void
+func ResizeBuffer(Buffer *buffer, int width, int height)
+{
+	int pitch_alignment = ARENA_ALIGNMENT / sizeof(unsigned int);
+	int pitch = (width + pitch_alignment - 1) / pitch_alignment * pitch_alignment;
+	int pixel_n = pitch * height;
+
+	int plane_n = 1 + (buffer->store_cube_face_ids ? 1 : 0) + (buffer->depth_test ? 1 : 0);
+	size_t size = plane_n * (pixel_n * sizeof(unsigned int) + ARENA_ALIGNMENT);
+	if(buffer->use_palette) size += pixel_n * sizeof(unsigned char) + ARENA_ALIGNMENT;
+	if(size + ARENA_ALIGNMENT > buffer->memory.max_size) size += size / 4;
+	ReserveArena(&buffer->memory, size);
+
+	buffer->width = width;
+	buffer->height = height;
+	buffer->pitch = pitch;
+	buffer->resize_n++;
+
+	buffer->colors = ArenaPushArray(&buffer->memory, pixel_n, unsigned int);
+	buffer->cube_face_ids = buffer->store_cube_face_ids ? ArenaPushArray(&buffer->memory, pixel_n, unsigned int) : 0;
+	buffer->depths = buffer->depth_test ? ArenaPushArray(&buffer->memory, pixel_n, float) : 0;
+	buffer->color_indices = buffer->use_palette ? ArenaPushArray(&buffer->memory, pixel_n, unsigned char) : 0;
+}
+
+static void
+func FreeBuffer(Buffer *buffer)
+{
+	FreeArena(&buffer->memory);
+	*buffer = {};
+}
+
+static void
+func SetBufferDepthTest(Buffer *buffer, bool depth_test)
+{
+	buffer->depth_test = depth_test;
+	ResizeBuffer(buffer, buffer->width, buffer->height);
+}
+
+static void
+func SetBufferStoreCubeFaceIds(Buffer *buffer, bool store_cube_face_ids)
+{
+	buffer->store_cube_face_ids = store_cube_face_ids;
+	ResizeBuffer(buffer, buffer->width, buffer->height);
+}
+
+static void
+func SetBufferUsePalette(Buffer *buffer, bool use_palette)
+{
+	buffer->use_palette = use_palette;
+	ResizeBuffer(buffer, buffer->width, buffer->height);
+}
+
+#define MAX_OUTLINE_THICKNESS 8
+
+// Outlines need the face ids, so they are turned on with them.
+static void
+func SetBufferOutline(Buffer *buffer, int outline_thickness, unsigned int outline_color)
+{
+	if(outline_thickness < 0) outline_thickness = 0;
+	if(outline_thickness > MAX_OUTLINE_THICKNESS) outline_thickness = MAX_OUTLINE_THICKNESS;
+
+	buffer->outline_thickness = outline_thickness;
+	buffer->outline_color = outline_color;
+	if(outline_thickness > 0 && !buffer->store_cube_face_ids) SetBufferStoreCubeFaceIds(buffer, true);
+}
+
+static void
+func SetPixelColor(Buffer *buffer, int row, int col, unsigned int color)
+{
+	Assert(row >= 0 && row < buffer->height);
+	Assert(col >= 0 && col < buffer->width);
+
+	buffer->colors[row * buffer->pitch + col] = color;
+}
+
+static void
+func SetPixelCubeFaceId(Buffer *buffer, int row, int col, unsigned int cube_face_id)
+{
+	Assert(row >= 0 && row < buffer->height);
+	Assert(col >= 0 && col < buffer->width);
+
+	buffer->cube_face_ids[row * buffer->pitch + col] = cube_face_id;
+}
+
+static unsigned int
+func GetPixelColorChecked(Buffer *buffer, int row, int col)
+{
+	unsigned int color = 0;
+	if((row >= 0 && row < buffer->height) && (col >= 0 && col < buffer->width))
+	{
+		color = buffer->colors[row * buffer->pitch + col];
+	}
+
+	return color;
+}
+
+static unsigned int
+func GetPixelCubeFaceIdChecked(Buffer *buffer, int row, int col)
+{
+	unsigned int cube_face_id = 0;
+	if(buffer->store_cube_face_ids && (row >= 0 && row < buffer->height) && (col >= 0 && col < buffer->width))
+	{
+		cube_face_id = buffer->cube_face_ids[row * buffer->pitch + col];
+	}
+
+	return cube_face_id;
+}
+
+static V2
+func ProjectToScreen(V3 p3)
+{
+	V2 p2 = Point2(p3.x, p3.y);
+	return p2;
+}
+
+// Lines step along their major axis one pixel at a time. The minor coordinate of step i is the start plus
+// i * minor_delta / step_n rounded to the nearest pixel, so every pixel only depends on its step. The steps inside
+// the clip rect are found up front, tiles drawing parts of the same line agree on every pixel, and the inner loop
+// does no bounds checks.
+// With depth test on, a line pixel is drawn if it is at most depth_bias behind what is already there,
+// so edges stay visible on top of the faces they border. Drawn pixels keep the biased depth, that way
+// faces drawn after the edge cannot cover it either and the result does not depend on the draw order.
+static void
+func DrawLine3(Buffer *buffer, ClipRect clip, V3 p1, V3 p2, unsigned int color, float depth_bias)
+{
+	int x1 = (int)floorf(p1.x);
+	int y1 = (int)floorf(p1.y);
+	int x2 = (int)floorf(p2.x);
+	int y2 = (int)floorf(p2.y);
+
+	bool x_major = (IntAbs(x2 - x1) >= IntAbs(y2 - y1));
+
+	int major1 = x_major ? x1 : y1;
+	int major2 = x_major ? x2 : y2;
+	int minor1 = x_major ? y1 : x1;
+	int minor2 = x_major ? y2 : x2;
+
+	int clip_major_min = x_major ? clip.min_col : clip.min_row;
+	int clip_major_max = x_major ? clip.max_col : clip.max_row;
+	int clip_minor_min = x_major ? clip.min_row : clip.min_col;
+	int clip_minor_max = x_major ? clip.max_row : clip.max_col;
+
+	int major_add = (major2 >= major1) ? 1 : -1;
+	int minor_add = (minor2 >= minor1) ? 1 : -1;
+	int step_n = IntAbs(major2 - major1);
+	int minor_delta = IntAbs(minor2 - minor1);
+
+	// Steps with the major coordinate inside the clip rect.
+	int first_step = (major_add > 0) ? (clip_major_min - major1) : (major1 - clip_major_max);
+	int last_step = (major_add > 0) ? (clip_major_max - major1) : (major1 - clip_major_min);
+	if(first_step < 0) first_step = 0;
+	if(last_step > step_n) last_step = step_n;
+
+	// The minor offset from minor1 has to be between these two, it never decreases along the line.
+	int min_offset = (minor_add > 0) ? (clip_minor_min - minor1) : (minor1 - clip_minor_max);
+	int max_offset = (minor_add > 0) ? (clip_minor_max - minor1) : (minor1 - clip_minor_min);
+	if(max_offset < 0 || min_offset > minor_delta) return;
+
+	// The offset at step i is (2 * i * minor_delta + step_n) / (2 * step_n), rounded down.
+	long long step_n2 = 2 * (long long)step_n;
+	long long minor_delta2 = 2 * (long long)minor_delta;
+	if(minor_delta > 0)
+	{
+		if(min_offset > 0)
+		{
+			long long numerator = (2 * (long long)min_offset - 1) * step_n;
+			int step = (int)((numerator + minor_delta2 - 1) / minor_delta2);
+			if(first_step < step) first_step = step;
+		}
+		if(max_offset < minor_delta)
+		{
+			long long numerator = (2 * (long long)max_offset + 1) * step_n;
+			int step = (int)((numerator + minor_delta2 - 1) / minor_delta2) - 1;
+			if(last_step > step) last_step = step;
+		}
+	}
+
+	if(first_step > last_step) return;
+
+	long long numerator = minor_delta2 * first_step + step_n;
+	int offset = (step_n > 0) ? (int)(numerator / step_n2) : 0;
+	long long remainder = (step_n > 0) ? (numerator % step_n2) : 0;
+
+	int major = major1 + major_add * first_step;
+	int minor = minor1 + minor_add * offset;
+	int row = x_major ? minor : major;
+	int col = x_major ? major : minor;
+
+	int index = row * buffer->pitch + col;
+	int major_stride = x_major ? major_add : major_add * buffer->pitch;
+	int minor_stride = x_major ? minor_add * buffer->pitch : minor_add;
+
+	float z_step = (step_n > 0) ? (p2.z - p1.z) / (float)step_n : 0.0f;
+	float z = p1.z + depth_bias + (float)first_step * z_step;
+
+	unsigned int *colors = buffer->colors;
+	unsigned char *color_indices = buffer->color_indices;
+	float *depths = buffer->depths;
+	bool depth_test = buffer->depth_test;
+	bool use_palette = buffer->use_palette;
+	for(int step = first_step; step <= last_step; step++)
+	{
+		if(!depth_test || z > depths[index])
+		{
+			if(depth_test) depths[index] = z;
+			if(use_palette) color_indices[index] = (unsigned char)color;
+			else colors[index] = color;
+		}
+
+		index += major_stride;
+		remainder += minor_delta2;
+		if(remainder >= step_n2)
+		{
+			remainder -= step_n2;
+			index += minor_stride;
+		}
+		z += z_step;
+	}
+}
+
+// Quad corners are snapped to a fixed-point grid so that the edge functions are exact integers
+// and two quads sharing an edge agree on every pixel along it.
+#define RASTER_SUBPIXEL_BITS 4
+#define RASTER_SUBPIXEL_ONE (1 << RASTER_SUBPIXEL_BITS)
+
+struct QuadRaster
+{
+	int min_col, max_col;
+	int min_row, max_row;
+
+	// Edge function values at (min_col, min_row), a pixel is inside if all four are non-negative.
+	long long w[4];
+	long long w_col_step[4];
+	long long w_row_step[4];
+
+	// Every edge value the SIMD kernels can reach, including the padding after max_col, fits into 32 bits.
+	bool fits_int32;
+
+	// Depth of the quad's plane at (min_col, min_row). Every kernel computes the depth of a pixel
+	// from these with the same operations, so they all agree on the result of the depth test.
+	float z;
+	float z_col_step;
+	float z_row_step;
+};
+
+#define RASTER_SIMD_WIDTH 8
+
+static int
+func SnapToSubpixel(float x)
+{
+	int snapped = (int)floorf(x * (float)RASTER_SUBPIXEL_ONE + 0.5f);
+	return snapped;
+}
+
+static int
+func SubpixelCeilToPixel(int x)
+{
+	int pixel = (x + RASTER_SUBPIXEL_ONE - 1) >> RASTER_SUBPIXEL_BITS;
+	return pixel;
+}
+
+static int
+func SubpixelFloorToPixel(int x)
+{
+	int pixel = x >> RASTER_SUBPIXEL_BITS;
+	return pixel;
+}
+
+// The quad has to turn right at every corner (see IsValidQuad2), so the inside is to the right of each edge.
+// Pixels exactly on an edge belong to the quad only if it is a top or a left edge,
+// this way a pixel on an edge shared by two quads is filled exactly once.
+static bool
+func SetupQuadRaster(QuadRaster *raster, Quad2 quad, ClipRect clip)
+{
+	int x[4] = {};
+	int y[4] = {};
+	for(int i = 0; i < 4; i++)
+	{
+		x[i] = SnapToSubpixel(quad.p[i].x);
+		y[i] = SnapToSubpixel(quad.p[i].y);
+	}
+
+	int min_x = x[0];
+	int max_x = x[0];
+	int min_y = y[0];
+	int max_y = y[0];
+	for(int i = 1; i < 4; i++)
+	{
+		if(x[i] < min_x) min_x = x[i];
+		if(x[i] > max_x) max_x = x[i];
+		if(y[i] < min_y) min_y = y[i];
+		if(y[i] > max_y) max_y = y[i];
+	}
+
+	raster->min_col = SubpixelCeilToPixel(min_x);
+	raster->max_col = SubpixelFloorToPixel(max_x);
+	raster->min_row = SubpixelCeilToPixel(min_y);
+	raster->max_row = SubpixelFloorToPixel(max_y);
+
+	if(raster->min_col < clip.min_col) raster->min_col = clip.min_col;
+	if(raster->max_col > clip.max_col) raster->max_col = clip.max_col;
+	if(raster->min_row < clip.min_row) raster->min_row = clip.min_row;
+	if(raster->max_row > clip.max_row) raster->max_row = clip.max_row;
+
+	bool is_empty = (raster->min_col > raster->max_col || raster->min_row > raster->max_row);
+	if(!is_empty)
+	{
+		long long start_x = (long long)raster->min_col << RASTER_SUBPIXEL_BITS;
+		long long start_y = (long long)raster->min_row << RASTER_SUBPIXEL_BITS;
+		for(int i = 0; i < 4; i++)
+		{
+			int next = (i + 1) % 4;
+			long long dx = (long long)(x[next] - x[i]);
+			long long dy = (long long)(y[next] - y[i]);
+
+			bool is_top_left = (dy > 0 || (dy == 0 && dx > 0));
+			long long bias = is_top_left ? 0 : -1;
+
+			raster->w[i] = dy * (start_x - x[i]) - dx * (start_y - y[i]) + bias;
+			raster->w_col_step[i] = dy << RASTER_SUBPIXEL_BITS;
+			raster->w_row_step[i] = -(dx << RASTER_SUBPIXEL_BITS);
+		}
+
+		long long col_n = raster->max_col - raster->min_col + RASTER_SIMD_WIDTH;
+		long long row_n = raster->max_row - raster->min_row;
+
+		raster->fits_int32 = true;
+		for(int i = 0; i < 4; i++)
+		{
+			long long corners[4] =
+			{
+				raster->w[i],
+				raster->w[i] + col_n * raster->w_col_step[i],
+				raster->w[i] + row_n * raster->w_row_step[i],
+				raster->w[i] + col_n * raster->w_col_step[i] + row_n * raster->w_row_step[i]
+			};
+
+			for(int j = 0; j < 4; j++)
+			{
+				if(corners[j] < -0x7FFFFFFFLL || corners[j] > 0x7FFFFFFFLL) raster->fits_int32 = false;
+			}
+		}
+	}
+
+	return !is_empty;
+}
+
+// Quads are parallelograms in 3D, so the depth over the projected quad is a plane through any three corners.
+static void
+func SetupQuadDepth(QuadRaster *raster, Quad3 quad)
+{
+	V3 p0 = quad.p[0];
+	V3 e1 = quad.p[1] - p0;
+	V3 e2 = quad.p[2] - p0;
+
+	float normal_x = e1.y * e2.z - e1.z * e2.y;
+	float normal_y = e1.z * e2.x - e1.x * e2.z;
+	float normal_z = e1.x * e2.y - e1.y * e2.x;
+	Assert(normal_z != 0.0f);
+
+	raster->z_col_step = -normal_x / normal_z;
+	raster->z_row_step = -normal_y / normal_z;
+	raster->z = p0.z + raster->z_col_step * ((float)raster->min_col - p0.x) + raster->z_row_step * ((float)raster->min_row - p0.y);
+}
+
+// Byte i of masks[lane_bits] is 0xFF if bit i of lane_bits is set. It turns the lane mask of a SIMD block
+// into a mask over the palette indices of its pixels.
+struct LaneByteMasks
+{
+	unsigned long long masks[256];
+};
+
+static constexpr LaneByteMasks
+func GenerateLaneByteMasks()
+{
+	LaneByteMasks table = {};
+	for(int lane_bits = 0; lane_bits < 256; lane_bits++)
+	{
+		for(int lane = 0; lane < 8; lane++)
+		{
+			if(lane_bits & (1 << lane)) table.masks[lane_bits] |= 0xFFull << (8 * lane);
+		}
+	}
+
+	return table;
+}
+
+static constexpr LaneByteMasks lane_byte_masks = GenerateLaneByteMasks();
+
+// Writes index into the pixels of a block of lane_n whose bit is set in lane_bits. The other pixels are read
+// and written back, so the whole block has to be inside the clip rect, the pixels after it can belong to
+// a tile that another thread draws.
+static void
+func StoreIndexLanes(unsigned char *color_indices, int lane_n, int lane_bits, unsigned int index)
+{
+	Assert(lane_n <= 8);
+	unsigned long long mask = lane_byte_masks.masks[lane_bits];
+	unsigned long long indices = 0x0101010101010101ull * (unsigned char)index;
+
+	unsigned long long block = 0;
+	memcpy(&block, color_indices, lane_n);
+	block = (block & ~mask) | (indices & mask);
+	memcpy(color_indices, &block, lane_n);
+}
+
+// With a palette, color is the palette index, in every fill and outline kernel.
+static void
+func FillQuadScalar(Buffer *buffer, QuadRaster *raster, unsigned int color, unsigned int cube_face_id)
+{
+	bool depth_test = buffer->depth_test;
+	bool store_cube_face_ids = buffer->store_cube_face_ids;
+	bool use_palette = buffer->use_palette;
+
+	// Written pixels are only counted for the profile, without it the count is dropped by the compiler.
+	int filled_n = 0;
+
+	long long w_row0 = raster->w[0];
+	long long w_row1 = raster->w[1];
+	long long w_row2 = raster->w[2];
+	long long w_row3 = raster->w[3];
+	for(int row = raster->min_row; row <= raster->max_row; row++)
+	{
+		unsigned int *colors = buffer->colors + row * buffer->pitch;
+		unsigned char *color_indices = use_palette ? (buffer->color_indices + row * buffer->pitch) : 0;
+		unsigned int *cube_face_ids = store_cube_face_ids ? (buffer->cube_face_ids + row * buffer->pitch) : 0;
+		float *depths = depth_test ? (buffer->depths + row * buffer->pitch) : 0;
+		float z_row = raster->z + (float)(row - raster->min_row) * raster->z_row_step;
+
+		long long w0 = w_row0;
+		long long w1 = w_row1;
+		long long w2 = w_row2;
+		long long w3 = w_row3;
+		for(int col = raster->min_col; col <= raster->max_col; col++)
+		{
+			if((w0 | w1 | w2 | w3) >= 0)
+			{
+				bool is_visible = true;
+				if(depth_test)
+				{
+					float z = z_row + (float)(col - raster->min_col) * raster->z_col_step;
+					is_visible = (z > depths[col]);
+					if(is_visible) depths[col] = z;
+				}
+
+				if(is_visible)
+				{
+					if(use_palette) color_indices[col] = (unsigned char)color;
+					else colors[col] = color;
+					if(store_cube_face_ids) cube_face_ids[col] = cube_face_id;
+					filled_n++;
+				}
+			}
+
+			w0 += raster->w_col_step[0];
+			w1 += raster->w_col_step[1];
+			w2 += raster->w_col_step[2];
+			w3 += raster->w_col_step[3];
+		}
+
+		w_row0 += raster->w_row_step[0];
+		w_row1 += raster->w_row_step[1];
+		w_row2 += raster->w_row_step[2];
+		w_row3 += raster->w_row_step[3];
+	}
+
+	PROFILE_COUNT(PROFILE_PIXELS, filled_n);
+}
+
+#if SIMD_X86
+
+static int
+func SumLanes4(__m128i v)
+{
+	int lanes[4] = {};
+	_mm_storeu_si128((__m128i *)lanes, v);
+	int sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	return sum;
+}
+
+static SIMD_TARGET_AVX2 int
+func SumLanes8(__m256i v)
+{
+	int sum = SumLanes4(_mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+	return sum;
+}
+
+// 4 pixels per step. SSE2 has no 32-bit masked store, so partly covered blocks are blended in
+// and the last block of a row is written pixel by pixel to stay inside the row.
+static void
+func FillQuadSse2(Buffer *buffer, QuadRaster *raster, unsigned int color, unsigned int cube_face_id)
+{
+	Assert(raster->fits_int32);
+
+	bool depth_test = buffer->depth_test;
+	bool store_cube_face_ids = buffer->store_cube_face_ids;
+	bool use_palette = buffer->use_palette;
+
+	__m128i w_row[4];
+	__m128i w_col_step[4];
+	__m128i w_row_step[4];
+	for(int i = 0; i < 4; i++)
+	{
+		int w = (int)raster->w[i];
+		int step = (int)raster->w_col_step[i];
+		w_row[i] = _mm_setr_epi32(w, w + step, w + 2 * step, w + 3 * step);
+		w_col_step[i] = _mm_set1_epi32(4 * step);
+		w_row_step[i] = _mm_set1_epi32((int)raster->w_row_step[i]);
+	}
+
+	__m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+	__m128i minus_one = _mm_set1_epi32(-1);
+	__m128i color_4 = _mm_set1_epi32((int)color);
+	__m128i cube_face_id_4 = _mm_set1_epi32((int)cube_face_id);
+	__m128 z_col_step = _mm_set1_ps(raster->z_col_step);
+
+	// Covered lanes are -1, subtracting the masks counts the written pixels.
+	__m128i filled_4 = _mm_setzero_si128();
+	int filled_n = 0;
+
+	for(int row = raster->min_row; row <= raster->max_row; row++)
+	{
+		unsigned int *colors = buffer->colors + row * buffer->pitch;
+		unsigned char *color_indices = use_palette ? (buffer->color_indices + row * buffer->pitch) : 0;
+		unsigned int *cube_face_ids = store_cube_face_ids ? (buffer->cube_face_ids + row * buffer->pitch) : 0;
+		float *depths = depth_test ? (buffer->depths + row * buffer->pitch) : 0;
+		float z_row = raster->z + (float)(row - raster->min_row) * raster->z_row_step;
+
+		__m128i w0 = w_row[0];
+		__m128i w1 = w_row[1];
+		__m128i w2 = w_row[2];
+		__m128i w3 = w_row[3];
+		for(int col = raster->min_col; col <= raster->max_col; col += 4)
+		{
+			__m128i w_all = _mm_or_si128(_mm_or_si128(w0, w1), _mm_or_si128(w2, w3));
+			__m128i mask = _mm_cmpgt_epi32(w_all, minus_one);
+
+			int lane_bits = _mm_movemask_ps(_mm_castsi128_ps(mask));
+			int remaining = raster->max_col - col + 1;
+			if(remaining < 4)
+			{
+				for(int lane = 0; lane < remaining; lane++)
+				{
+					if(lane_bits & (1 << lane))
+					{
+						bool is_visible = true;
+						if(depth_test)
+						{
+							float z = z_row + (float)(col + lane - raster->min_col) * raster->z_col_step;
+							is_visible = (z > depths[col + lane]);
+							if(is_visible) depths[col + lane] = z;
+						}
+
+						if(is_visible)
+						{
+							if(use_palette) color_indices[col + lane] = (unsigned char)color;
+							else colors[col + lane] = color;
+							if(store_cube_face_ids) cube_face_ids[col + lane] = cube_face_id;
+							filled_n++;
+						}
+					}
+				}
+
+				lane_bits = 0;
+			}
+			else if(lane_bits && depth_test)
+			{
+				__m128 col_offset = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(col - raster->min_col), lanes));
+				__m128 z = _mm_add_ps(_mm_set1_ps(z_row), _mm_mul_ps(col_offset, z_col_step));
+
+				__m128 old_z = _mm_loadu_ps(depths + col);
+				mask = _mm_and_si128(mask, _mm_castps_si128(_mm_cmpgt_ps(z, old_z)));
+				lane_bits = _mm_movemask_ps(_mm_castsi128_ps(mask));
+
+				__m128 z_mask = _mm_castsi128_ps(mask);
+				_mm_storeu_ps(depths + col, _mm_or_ps(_mm_and_ps(z_mask, z), _mm_andnot_ps(z_mask, old_z)));
+			}
+
+			if(lane_bits) filled_4 = _mm_sub_epi32(filled_4, mask);
+			if(lane_bits && use_palette) StoreIndexLanes(color_indices + col, 4, lane_bits, color);
+			if(lane_bits == 0xF)
+			{
+				if(!use_palette) _mm_storeu_si128((__m128i *)(colors + col), color_4);
+				if(store_cube_face_ids) _mm_storeu_si128((__m128i *)(cube_face_ids + col), cube_face_id_4);
+			}
+			else if(lane_bits)
+			{
+				if(!use_palette)
+				{
+					__m128i *color_p = (__m128i *)(colors + col);
+					__m128i old_color = _mm_loadu_si128(color_p);
+					__m128i new_color = _mm_or_si128(_mm_and_si128(mask, color_4), _mm_andnot_si128(mask, old_color));
+					_mm_storeu_si128(color_p, new_color);
+				}
+
+				if(store_cube_face_ids)
+				{
+					__m128i *cube_face_id_p = (__m128i *)(cube_face_ids + col);
+					__m128i old_cube_face_id = _mm_loadu_si128(cube_face_id_p);
+					__m128i new_cube_face_id = _mm_or_si128(_mm_and_si128(mask, cube_face_id_4), _mm_andnot_si128(mask, old_cube_face_id));
+					_mm_storeu_si128(cube_face_id_p, new_cube_face_id);
+				}
+			}
+
+			w0 = _mm_add_epi32(w0, w_col_step[0]);
+			w1 = _mm_add_epi32(w1, w_col_step[1]);
+			w2 = _mm_add_epi32(w2, w_col_step[2]);
+			w3 = _mm_add_epi32(w3, w_col_step[3]);
+		}
+
+		for(int i = 0; i < 4; i++) w_row[i] = _mm_add_epi32(w_row[i], w_row_step[i]);
+	}
+
+	PROFILE_COUNT(PROFILE_PIXELS, filled_n + SumLanes4(filled_4));
+}
+
+// 8 pixels per step, only the covered pixels are written with masked stores. Palette indices are merged
+// into the row a block at a time, see StoreIndexLanes.
+static SIMD_TARGET_AVX2 void
+func FillQuadAvx2(Buffer *buffer, QuadRaster *raster, unsigned int color, unsigned int cube_face_id)
+{
+	Assert(raster->fits_int32);
+
+	bool depth_test = buffer->depth_test;
+	bool store_cube_face_ids = buffer->store_cube_face_ids;
+	bool use_palette = buffer->use_palette;
+
+	__m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	__m256i w_row[4];
+	__m256i w_col_step[4];
+	__m256i w_row_step[4];
+	for(int i = 0; i < 4; i++)
+	{
+		int step = (int)raster->w_col_step[i];
+		w_row[i] = _mm256_add_epi32(_mm256_set1_epi32((int)raster->w[i]), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(step)));
+		w_col_step[i] = _mm256_set1_epi32(8 * step);
+		w_row_step[i] = _mm256_set1_epi32((int)raster->w_row_step[i]);
+	}
+
+	__m256i minus_one = _mm256_set1_epi32(-1);
+	__m256i color_8 = _mm256_set1_epi32((int)color);
+	__m256i cube_face_id_8 = _mm256_set1_epi32((int)cube_face_id);
+	__m256 z_col_step = _mm256_set1_ps(raster->z_col_step);
+	__m256i filled_8 = _mm256_setzero_si256();
+
+	for(int row = raster->min_row; row <= raster->max_row; row++)
+	{
+		unsigned int *colors = buffer->colors + row * buffer->pitch;
+		unsigned char *color_indices = use_palette ? (buffer->color_indices + row * buffer->pitch) : 0;
+		unsigned int *cube_face_ids = store_cube_face_ids ? (buffer->cube_face_ids + row * buffer->pitch) : 0;
+		float *depths = depth_test ? (buffer->depths + row * buffer->pitch) : 0;
+		float z_row = raster->z + (float)(row - raster->min_row) * raster->z_row_step;
+
+		__m256i w0 = w_row[0];
+		__m256i w1 = w_row[1];
+		__m256i w2 = w_row[2];
+		__m256i w3 = w_row[3];
+		for(int col = raster->min_col; col <= raster->max_col; col += 8)
+		{
+			__m256i w_all = _mm256_or_si256(_mm256_or_si256(w0, w1), _mm256_or_si256(w2, w3));
+			__m256i mask = _mm256_cmpgt_epi32(w_all, minus_one);
+
+			int remaining = raster->max_col - col + 1;
+			if(remaining < 8) mask = _mm256_and_si256(mask, _mm256_cmpgt_epi32(_mm256_set1_epi32(remaining), lanes));
+
+			int lane_bits = _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+			if(lane_bits && depth_test)
+			{
+				__m256 col_offset = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(col - raster->min_col), lanes));
+				__m256 z = _mm256_add_ps(_mm256_set1_ps(z_row), _mm256_mul_ps(col_offset, z_col_step));
+
+				__m256 old_z = _mm256_maskload_ps(depths + col, mask);
+				mask = _mm256_and_si256(mask, _mm256_castps_si256(_mm256_cmp_ps(z, old_z, _CMP_GT_OQ)));
+				lane_bits = _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+
+				_mm256_maskstore_ps(depths + col, mask, z);
+			}
+
+			filled_8 = _mm256_sub_epi32(filled_8, mask);
+			if(lane_bits && use_palette)
+			{
+				if(remaining >= 8)
+				{
+					StoreIndexLanes(color_indices + col, 8, lane_bits, color);
+				}
+				else
+				{
+					for(int lane = 0; lane < remaining; lane++)
+					{
+						if(lane_bits & (1 << lane)) color_indices[col + lane] = (unsigned char)color;
+					}
+				}
+			}
+
+			if(lane_bits == 0xFF)
+			{
+				if(!use_palette) _mm256_storeu_si256((__m256i *)(colors + col), color_8);
+				if(store_cube_face_ids) _mm256_storeu_si256((__m256i *)(cube_face_ids + col), cube_face_id_8);
+			}
+			else if(lane_bits)
+			{
+				if(!use_palette) _mm256_maskstore_epi32((int *)(colors + col), mask, color_8);
+				if(store_cube_face_ids) _mm256_maskstore_epi32((int *)(cube_face_ids + col), mask, cube_face_id_8);
+			}
+
+			w0 = _mm256_add_epi32(w0, w_col_step[0]);
+			w1 = _mm256_add_epi32(w1, w_col_step[1]);
+			w2 = _mm256_add_epi32(w2, w_col_step[2]);
+			w3 = _mm256_add_epi32(w3, w_col_step[3]);
+		}
+
+		for(int i = 0; i < 4; i++) w_row[i] = _mm256_add_epi32(w_row[i], w_row_step[i]);
+	}
+
+	PROFILE_COUNT(PROFILE_PIXELS, SumLanes8(filled_8));
+}
+
+#endif
+
+static void
+func DrawQuad3(Buffer *buffer, ClipRect clip, Quad3 quad3, unsigned int color, unsigned int cube_face_id)
+{
+	Quad2 quad = {};
+	for(int i = 0; i < 4; i++)
+	{
+		quad.p[i] = ProjectToScreen(quad3.p[i]);
+	}
+
+	Assert(IsValidQuad2(quad));
+
+	QuadRaster raster = {};
+	if(!SetupQuadRaster(&raster, quad, clip)) return;
+
+	if(buffer->depth_test) SetupQuadDepth(&raster, quad3);
+
+	int simd_level = raster.fits_int32 ? GetSimdLevel() : SIMD_NONE;
+	switch(simd_level)
+	{
+#if SIMD_X86
+		case SIMD_AVX2:
+		{
+			FillQuadAvx2(buffer, &raster, color, cube_face_id);
+			break;
+		}
+		case SIMD_SSE2:
+		{
+			FillQuadSse2(buffer, &raster, color, cube_face_id);
+			break;
+		}
+#endif
+		default:
+		{
+			FillQuadScalar(buffer, &raster, color, cube_face_id);
+			break;
+		}
+	}
+}
+
+// A pixel is on an outline if the face id changes within outline_thickness pixels to its right or above it,
+// so outlines sit on the left and lower side of every face border and the silhouette.
+static bool
+func IsOutlinePixel(Buffer *buffer, int row, int col)
+{
+	int thickness = buffer->outline_thickness;
+	int col_step_n = (col + thickness < buffer->width) ? thickness : (buffer->width - 1 - col);
+	int row_step_n = (row + thickness < buffer->height) ? thickness : (buffer->height - 1 - row);
+
+	unsigned int *cube_face_ids = buffer->cube_face_ids + row * buffer->pitch + col;
+	unsigned int cube_face_id = cube_face_ids[0];
+
+	bool is_outline = false;
+	for(int step = 1; step <= col_step_n; step++)
+	{
+		if(cube_face_ids[step] != cube_face_id) is_outline = true;
+	}
+	for(int step = 1; step <= row_step_n; step++)
+	{
+		if(cube_face_ids[step * buffer->pitch] != cube_face_id) is_outline = true;
+	}
+
+	return is_outline;
+}
+
+static void
+func DrawOutlinesScalar(Buffer *buffer, ClipRect clip, int col_begin, unsigned int color)
+{
+	for(int row = clip.min_row; row <= clip.max_row; row++)
+	{
+		unsigned int *colors = buffer->colors + row * buffer->pitch;
+		unsigned char *color_indices = buffer->use_palette ? (buffer->color_indices + row * buffer->pitch) : 0;
+		for(int col = col_begin; col <= clip.max_col; col++)
+		{
+			if(IsOutlinePixel(buffer, row, col))
+			{
+				if(color_indices) color_indices[col] = (unsigned char)color;
+				else colors[col] = color;
+			}
+		}
+	}
+}
+
+// Blocks of block_width pixels only go as far right as every id they compare with is still inside the row,
+// the rest of the row is left to DrawOutlinesScalar.
+static int
+func GetOutlineBlockColEnd(Buffer *buffer, ClipRect clip, int block_width)
+{
+	int col_end = buffer->width - buffer->outline_thickness;
+	if(col_end > clip.max_col + 1) col_end = clip.max_col + 1;
+
+	int block_n = (col_end > clip.min_col) ? (col_end - clip.min_col) / block_width : 0;
+	int block_col_end = clip.min_col + block_n * block_width;
+	return block_col_end;
+}
+
+#if SIMD_X86
+
+static void
+func DrawOutlinesSse2(Buffer *buffer, ClipRect clip, unsigned int color)
+{
+	int thickness = buffer->outline_thickness;
+	int block_col_end = GetOutlineBlockColEnd(buffer, clip, 4);
+	__m128i color_4 = _mm_set1_epi32((int)color);
+
+	for(int row = clip.min_row; row <= clip.max_row; row++)
+	{
+		int row_step_n = (row + thickness < buffer->height) ? thickness : (buffer->height - 1 - row);
+		unsigned int *colors = buffer->colors + row * buffer->pitch;
+		unsigned char *color_indices = buffer->use_palette ? (buffer->color_indices + row * buffer->pitch) : 0;
+		unsigned int *cube_face_ids = buffer->cube_face_ids + row * buffer->pitch;
+
+		for(int col = clip.min_col; col < block_col_end; col += 4)
+		{
+			__m128i cube_face_id = _mm_loadu_si128((__m128i *)(cube_face_ids + col));
+			__m128i same = _mm_set1_epi32(-1);
+			for(int step = 1; step <= thickness; step++)
+			{
+				__m128i next_id = _mm_loadu_si128((__m128i *)(cube_face_ids + col + step));
+				same = _mm_and_si128(same, _mm_cmpeq_epi32(cube_face_id, next_id));
+			}
+			for(int step = 1; step <= row_step_n; step++)
+			{
+				__m128i next_id = _mm_loadu_si128((__m128i *)(cube_face_ids + col + step * buffer->pitch));
+				same = _mm_and_si128(same, _mm_cmpeq_epi32(cube_face_id, next_id));
+			}
+
+			int same_bits = _mm_movemask_ps(_mm_castsi128_ps(same));
+			if(same_bits != 0xF && color_indices)
+			{
+				StoreIndexLanes(color_indices + col, 4, same_bits ^ 0xF, color);
+			}
+			else if(same_bits != 0xF)
+			{
+				__m128i *color_p = (__m128i *)(colors + col);
+				__m128i old_color = _mm_loadu_si128(color_p);
+				_mm_storeu_si128(color_p, _mm_or_si128(_mm_and_si128(same, old_color), _mm_andnot_si128(same, color_4)));
+			}
+		}
+
+	}
+
+	DrawOutlinesScalar(buffer, clip, block_col_end, color);
+}
+
+static SIMD_TARGET_AVX2 void
+func DrawOutlinesAvx2(Buffer *buffer, ClipRect clip, unsigned int color)
+{
+	int thickness = buffer->outline_thickness;
+	int block_col_end = GetOutlineBlockColEnd(buffer, clip, 8);
+	__m256i minus_one = _mm256_set1_epi32(-1);
+	__m256i color_8 = _mm256_set1_epi32((int)color);
+
+	for(int row = clip.min_row; row <= clip.max_row; row++)
+	{
+		int row_step_n = (row + thickness < buffer->height) ? thickness : (buffer->height - 1 - row);
+		unsigned int *colors = buffer->colors + row * buffer->pitch;
+		unsigned char *color_indices = buffer->use_palette ? (buffer->color_indices + row * buffer->pitch) : 0;
+		unsigned int *cube_face_ids = buffer->cube_face_ids + row * buffer->pitch;
+
+		for(int col = clip.min_col; col < block_col_end; col += 8)
+		{
+			__m256i cube_face_id = _mm256_loadu_si256((__m256i *)(cube_face_ids + col));
+			__m256i same = minus_one;
+			for(int step = 1; step <= thickness; step++)
+			{
+				__m256i next_id = _mm256_loadu_si256((__m256i *)(cube_face_ids + col + step));
+				same = _mm256_and_si256(same, _mm256_cmpeq_epi32(cube_face_id, next_id));
+			}
+			for(int step = 1; step <= row_step_n; step++)
+			{
+				__m256i next_id = _mm256_loadu_si256((__m256i *)(cube_face_ids + col + step * buffer->pitch));
+				same = _mm256_and_si256(same, _mm256_cmpeq_epi32(cube_face_id, next_id));
+			}
+
+			int same_bits = _mm256_movemask_ps(_mm256_castsi256_ps(same));
+			if(same_bits != 0xFF && color_indices)
+			{
+				StoreIndexLanes(color_indices + col, 8, same_bits ^ 0xFF, color);
+			}
+			else if(same_bits != 0xFF)
+			{
+				__m256i mask = _mm256_xor_si256(same, minus_one);
+				_mm256_maskstore_epi32((int *)(colors + col), mask, color_8);
+			}
+		}
+
+	}
+
+	DrawOutlinesScalar(buffer, clip, block_col_end, color);
+}
+
+#endif
+
+// Draws the outlines inside the clip rect in color, the palette index of the outline color if the buffer
+// has a palette. Only colors are written, so rectangles next to each other can be outlined at the same time.
+static void
+func DrawOutlines(Buffer *buffer, ClipRect clip, unsigned int color)
+{
+	Assert(buffer->outline_thickness > 0 && buffer->store_cube_face_ids);
+
+	switch(GetSimdLevel())
+	{
+#if SIMD_X86
+		case SIMD_AVX2:
+		{
+			DrawOutlinesAvx2(buffer, clip, color);
+			break;
+		}
+		case SIMD_SSE2:
+		{
+			DrawOutlinesSse2(buffer, clip, color);
+			break;
+		}
+#endif
+		default:
+		{
+			DrawOutlinesScalar(buffer, clip, clip.min_col, color);
+			break;
+		}
+	}
+}
+// Indices are only ever added to a palette, pixels drawn with it keep their color for as long as it is used.
+#define MAX_PALETTE_COLOR_N 256
+
+struct Palette
+{
+	unsigned int colors[MAX_PALETTE_COLOR_N];
+	int color_n;
+};
+
+static unsigned int
+func GetPaletteIndex(Palette *palette, unsigned int color)
+{
+	for(int i = 0; i < palette->color_n; i++)
+	{
+		if(palette->colors[i] == color) return (unsigned int)i;
+	}
+
+	Assert(palette->color_n < MAX_PALETTE_COLOR_N);
+	palette->colors[palette->color_n] = color;
+	palette->color_n++;
+	return (unsigned int)(palette->color_n - 1);
+}
+
+static void
+func ResolveRowScalar(unsigned int *colors, unsigned char *color_indices, int pixel_n, unsigned int *palette_colors)
+{
+	for(int i = 0; i < pixel_n; i++)
+	{
+		colors[i] = palette_colors[color_indices[i]];
+	}
+}
+
+#if SIMD_X86
+
+// 32 pixels per step, for palettes of up to 16 colors. Every byte of the colors has a table of 16 entries,
+// so one byte shuffle per table looks up all 32 pixels. The unpacks interleave the four bytes into colors
+// within each 128-bit half, the permutes put the pixels back in order.
+static SIMD_TARGET_AVX2 void
+func ResolveRectAvx2(Buffer *buffer, ClipRect clip, Palette *palette)
+{
+	Assert(palette->color_n <= 16);
+
+	unsigned char byte_tables[4][16] = {};
+	for(int i = 0; i < palette->color_n; i++)
+	{
+		for(int byte = 0; byte < 4; byte++) byte_tables[byte][i] = (unsigned char)(palette->colors[i] >> (8 * byte));
+	}
+
+	__m256i tables[4];
+	for(int byte = 0; byte < 4; byte++)
+	{
+		tables[byte] = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)byte_tables[byte]));
+	}
+
+	int col_n = clip.max_col - clip.min_col + 1;
+	for(int row = clip.min_row; row <= clip.max_row; row++)
+	{
+		unsigned int *colors = buffer->colors + row * buffer->pitch + clip.min_col;
+		unsigned char *color_indices = buffer->color_indices + row * buffer->pitch + clip.min_col;
+
+		int i = 0;
+		for(; i + 32 <= col_n; i += 32)
+		{
+			__m256i indices = _mm256_loadu_si256((__m256i *)(color_indices + i));
+			__m256i byte0 = _mm256_shuffle_epi8(tables[0], indices);
+			__m256i byte1 = _mm256_shuffle_epi8(tables[1], indices);
+			__m256i byte2 = _mm256_shuffle_epi8(tables[2], indices);
+			__m256i byte3 = _mm256_shuffle_epi8(tables[3], indices);
+
+			__m256i low_words_lo = _mm256_unpacklo_epi8(byte0, byte1);
+			__m256i low_words_hi = _mm256_unpackhi_epi8(byte0, byte1);
+			__m256i high_words_lo = _mm256_unpacklo_epi8(byte2, byte3);
+			__m256i high_words_hi = _mm256_unpackhi_epi8(byte2, byte3);
+
+			// Pixels 0-3 and 16-19, 4-7 and 20-23, 8-11 and 24-27, 12-15 and 28-31.
+			__m256i pixels0 = _mm256_unpacklo_epi16(low_words_lo, high_words_lo);
+			__m256i pixels1 = _mm256_unpackhi_epi16(low_words_lo, high_words_lo);
+			__m256i pixels2 = _mm256_unpacklo_epi16(low_words_hi, high_words_hi);
+			__m256i pixels3 = _mm256_unpackhi_epi16(low_words_hi, high_words_hi);
+
+			_mm256_storeu_si256((__m256i *)(colors + i), _mm256_permute2x128_si256(pixels0, pixels1, 0x20));
+			_mm256_storeu_si256((__m256i *)(colors + i + 8), _mm256_permute2x128_si256(pixels2, pixels3, 0x20));
+			_mm256_storeu_si256((__m256i *)(colors + i + 16), _mm256_permute2x128_si256(pixels0, pixels1, 0x31));
+			_mm256_storeu_si256((__m256i *)(colors + i + 24), _mm256_permute2x128_si256(pixels2, pixels3, 0x31));
+		}
+
+		ResolveRowScalar(colors + i, color_indices + i, col_n - i, palette->colors);
+	}
+}
+
+#endif
+
+// Expands the palette indices inside the clip rect into colors. SSE2 has no byte shuffle, there a table lookup
+// per pixel is as fast as it gets.
+static void
+func ResolveRect(Buffer *buffer, ClipRect clip, Palette *palette)
+{
+	Assert(buffer->use_palette);
+	if(IsRectEmpty(clip)) return;
+
+	int simd_level = (palette->color_n <= 16) ? GetSimdLevel() : SIMD_NONE;
+	switch(simd_level)
+	{
+#if SIMD_X86
+		case SIMD_AVX2:
+		{
+			ResolveRectAvx2(buffer, clip, palette);
+			break;
+		}
+#endif
+		default:
+		{
+			int col_n = clip.max_col - clip.min_col + 1;
+			for(int row = clip.min_row; row <= clip.max_row; row++)
+			{
+				int offset = row * buffer->pitch + clip.min_col;
+				ResolveRowScalar(buffer->colors + offset, buffer->color_indices + offset, col_n, palette->colors);
+			}
+			break;
+		}
+	}
+}
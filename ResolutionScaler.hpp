@@ -0,0 +1,120 @@
+// Picks the scale the scene is drawn at from how long frames take. Over the budget the buffer shrinks
+// straight to the scale that should fit, with room to spare it grows one step at a time. Drawing time goes
+// with the pixel count, that is with the square of the scale.
+// Decisions are made on the average of RESOLUTION_SETTLE_FRAME_N frames. To not flip between two scales,
+// a step up has to be expected to take at most RESOLUTION_UPSCALE_HEADROOM of the budget.
+#define RESOLUTION_SCALE_STEP 0.125f
+#define RESOLUTION_SETTLE_FRAME_N 8
+#define RESOLUTION_UPSCALE_HEADROOM 0.75
+
+// Scaled frames are only for while the scene changes, once it has been still for this long it is drawn at the
+// largest scale again.
+#define RESOLUTION_STILL_SECONDS 0.25
+
+struct ResolutionScaler
+{
+	double budget_seconds;
+	float min_scale;
+	float max_scale;
+
+	bool is_enabled;
+	float scale;
+
+	// Average of the frames drawn since the last decision.
+	double average_seconds;
+	int averaged_frame_n;
+
+	long long measured_frame_n;
+	long long downscale_n;
+	long long upscale_n;
+};
+
+// The scales are rounded to steps and kept between one step and 1.
+static float
+func ClampResolutionScale(float scale)
+{
+	scale = floorf(scale / RESOLUTION_SCALE_STEP + 0.001f) * RESOLUTION_SCALE_STEP;
+	if(scale < RESOLUTION_SCALE_STEP) scale = RESOLUTION_SCALE_STEP;
+	if(scale > 1.0f) scale = 1.0f;
+	return scale;
+}
+
+static void
+func InitResolutionScaler(ResolutionScaler *scaler, double budget_seconds, float min_scale, float max_scale)
+{
+	*scaler = {};
+	scaler->budget_seconds = budget_seconds;
+	scaler->min_scale = ClampResolutionScale(min_scale);
+	scaler->max_scale = ClampResolutionScale(max_scale);
+	if(scaler->max_scale < scaler->min_scale) scaler->max_scale = scaler->min_scale;
+
+	scaler->is_enabled = (budget_seconds > 0.0);
+	scaler->scale = scaler->max_scale;
+}
+
+static void
+func SetResolutionScale(ResolutionScaler *scaler, float scale)
+{
+	if(scale < scaler->scale) scaler->downscale_n++;
+	if(scale > scaler->scale) scaler->upscale_n++;
+
+	scaler->scale = scale;
+}
+
+// Goes back to the largest scale and stays there until enabled again.
+static void
+func EnableResolutionScaler(ResolutionScaler *scaler, bool is_enabled)
+{
+	scaler->is_enabled = is_enabled && (scaler->budget_seconds > 0.0);
+	if(scaler->scale != scaler->max_scale) SetResolutionScale(scaler, scaler->max_scale);
+	scaler->average_seconds = 0.0;
+	scaler->averaged_frame_n = 0;
+}
+
+// Called with the time of every drawn frame, returns true if the scale changed.
+static bool
+func UpdateResolutionScale(ResolutionScaler *scaler, double frame_seconds)
+{
+	if(!scaler->is_enabled) return false;
+
+	scaler->measured_frame_n++;
+	scaler->averaged_frame_n++;
+	scaler->average_seconds += (frame_seconds - scaler->average_seconds) / (double)scaler->averaged_frame_n;
+	if(scaler->averaged_frame_n < RESOLUTION_SETTLE_FRAME_N) return false;
+
+	float scale = scaler->scale;
+	double average_seconds = scaler->average_seconds;
+	double budget_seconds = scaler->budget_seconds;
+
+	float new_scale = scale;
+	if(average_seconds > budget_seconds)
+	{
+		float fitting_scale = scale * sqrtf((float)(budget_seconds / average_seconds));
+		new_scale = ClampResolutionScale(fitting_scale);
+		if(new_scale >= scale) new_scale = scale - RESOLUTION_SCALE_STEP;
+		if(new_scale < scaler->min_scale) new_scale = scaler->min_scale;
+	}
+	else if(scale < scaler->max_scale)
+	{
+		float up_scale = scale + RESOLUTION_SCALE_STEP;
+		double up_seconds = average_seconds * (double)(up_scale * up_scale) / (double)(scale * scale);
+		if(up_seconds <= RESOLUTION_UPSCALE_HEADROOM * budget_seconds) new_scale = up_scale;
+	}
+
+	bool is_changed = (new_scale != scale);
+	if(is_changed) SetResolutionScale(scaler, new_scale);
+
+	scaler->average_seconds = 0.0;
+	scaler->averaged_frame_n = 0;
+
+	return is_changed;
+}
+
+// The buffer size for a window size at a scale, at least a pixel unless the window has none.
+static int
+func GetScaledSize(int window_size, float scale)
+{
+	int size = (int)((float)window_size * scale + 0.5f);
+	if(size < 1 && window_size > 0) size = 1;
+	return size;
+}
@@ -0,0 +1,1361 @@
+enum CubeCorner
+{
+	CORNER_LUF,
+	CORNER_LUB,
+	CORNER_LDF,
+	CORNER_LDB,
+	CORNER_RUF,
+	CORNER_RUB,
+	CORNER_RDF,
+	CORNER_RDB
+};
+
+V3 unit_cube_corners[8] =
+{
+	{-1.0, +1.0, +1.0f},
+	{-1.0, +1.0, -1.0f},
+	{-1.0, -1.0, +1.0f},
+	{-1.0, -1.0, -1.0f},
+	{+1.0, +1.0, +1.0f},
+	{+1.0, +1.0, -1.0f},
+	{+1.0, -1.0, +1.0f},
+	{+1.0, -1.0, -1.0f}
+};
+
+enum CubeFace
+{
+	FACE_L,
+	FACE_R,
+	FACE_U,
+	FACE_D,
+	FACE_F,
+	FACE_B
+};
+
+int cube_face_corners[6][4] =
+{
+	{CORNER_LUB, CORNER_LUF, CORNER_LDF, CORNER_LDB},
+	{CORNER_RUF, CORNER_RUB, CORNER_RDB, CORNER_RDF},
+	{CORNER_LUF, CORNER_LUB, CORNER_RUB, CORNER_RUF},
+	{CORNER_LDB, CORNER_LDF, CORNER_RDF, CORNER_RDB},
+	{CORNER_LUF, CORNER_RUF, CORNER_RDF, CORNER_LDF},
+	{CORNER_LUB, CORNER_LDB, CORNER_RDB, CORNER_RUB}
+};
+
+int cube_edges[12][2] =
+{
+	{CORNER_LUF, CORNER_RUF}, {CORNER_RUF, CORNER_RUB},
+	{CORNER_RUB, CORNER_LUB}, {CORNER_LUB, CORNER_LUF},
+
+	{CORNER_LDF, CORNER_RDF}, {CORNER_RDF, CORNER_RDB},
+	{CORNER_RDB, CORNER_LDB}, {CORNER_LDB, CORNER_LDF},
+
+	{CORNER_LUF, CORNER_LDF}, {CORNER_RUF, CORNER_RDF},
+	{CORNER_LUB, CORNER_LDB}, {CORNER_RUB, CORNER_RDB}
+};
+
+int cube_edge_faces[12][2] =
+{
+	{FACE_U, FACE_F}, {FACE_U, FACE_R},
+	{FACE_U, FACE_B}, {FACE_U, FACE_L},
+
+	{FACE_D, FACE_F}, {FACE_D, FACE_R},
+	{FACE_D, FACE_B}, {FACE_D, FACE_L},
+
+	{FACE_L, FACE_F}, {FACE_R, FACE_F},
+	{FACE_L, FACE_B}, {FACE_R, FACE_B}
+};
+
+unsigned int cube_face_colors[6] =
+{
+	0xFF8800,
+	0xFF0000,
+	0xFFFFFF,
+	0xFFFF00,
+	0x00FF00,
+	0x0000FF
+};
+
+// A cubie can only be turned into one of the 24 rotations of a cube, so its orientation is stored as an index.
+// Each rotation is a signed permutation matrix with determinant +1, index 0 is the identity. The tables are
+// generated by the compiler.
+#define ORIENTATION_N 24
+#define IDENTITY_ORIENTATION 0
+
+struct OrientationTables
+{
+	M3x3 matrices[ORIENTATION_N];
+
+	// products[a][b] is the orientation of matrices[a] * matrices[b], turning by b first and then by a.
+	int products[ORIENTATION_N][ORIENTATION_N];
+
+	// A quarter turn around the x, y and z axis, counterclockwise when the axis points towards the viewer.
+	int quarter_turns[3];
+};
+
+static constexpr OrientationTables
+func GenerateOrientationTables()
+{
+	OrientationTables tables = {};
+
+	// Row i of an orientation has its nonzero entry in column columns[i] with sign signs[i].
+	int columns[ORIENTATION_N][3] = {};
+	int signs[ORIENTATION_N][3] = {};
+
+	// Orientations by their rows, each row is coded as 2 * column + (sign < 0).
+	int orientations_by_rows[6 * 6 * 6] = {};
+
+	int permutations[6][3] = {{0, 1, 2}, {1, 2, 0}, {2, 0, 1}, {0, 2, 1}, {2, 1, 0}, {1, 0, 2}};
+	int permutation_signs[6] = {+1, +1, +1, -1, -1, -1};
+
+	int orientation = 0;
+	for(int permutation = 0; permutation < 6; permutation++)
+	{
+		for(int sign_bits = 0; sign_bits < 8; sign_bits++)
+		{
+			int determinant = permutation_signs[permutation];
+			for(int row = 0; row < 3; row++)
+			{
+				if(sign_bits & (1 << row)) determinant = -determinant;
+			}
+			if(determinant < 0) continue;
+
+			int rows_code = 0;
+			for(int row = 2; row >= 0; row--)
+			{
+				int column = permutations[permutation][row];
+				int sign = (sign_bits & (1 << row)) ? -1 : +1;
+
+				columns[orientation][row] = column;
+				signs[orientation][row] = sign;
+				tables.matrices[orientation].v[row][column] = (float)sign;
+				rows_code = 6 * rows_code + 2 * column + ((sign < 0) ? 1 : 0);
+			}
+
+			orientations_by_rows[rows_code] = orientation;
+			orientation++;
+		}
+	}
+
+	// Row i of a * b is row columns[a][i] of b, times signs[a][i].
+	for(int a = 0; a < ORIENTATION_N; a++)
+	{
+		for(int b = 0; b < ORIENTATION_N; b++)
+		{
+			int rows_code = 0;
+			for(int row = 2; row >= 0; row--)
+			{
+				int b_row = columns[a][row];
+				int sign = signs[a][row] * signs[b][b_row];
+				rows_code = 6 * rows_code + 2 * columns[b][b_row] + ((sign < 0) ? 1 : 0);
+			}
+
+			tables.products[a][b] = orientations_by_rows[rows_code];
+		}
+	}
+
+	// The quarter turn around axis k keeps row k, row k + 1 becomes minus row k + 2 and row k + 2 becomes row k + 1.
+	for(int axis = 0; axis < 3; axis++)
+	{
+		int row1 = (axis + 1) % 3;
+		int row2 = (axis + 2) % 3;
+
+		int row_codes[3] = {};
+		row_codes[axis] = 2 * axis;
+		row_codes[row1] = 2 * row2 + 1;
+		row_codes[row2] = 2 * row1;
+
+		int rows_code = row_codes[0] + 6 * row_codes[1] + 36 * row_codes[2];
+		tables.quarter_turns[axis] = orientations_by_rows[rows_code];
+	}
+
+	return tables;
+}
+
+static constexpr OrientationTables orientation_tables = GenerateOrientationTables();
+
+static M3x3
+func GetOrientationMatrix(int orientation)
+{
+	Assert(orientation >= 0 && orientation < ORIENTATION_N);
+	M3x3 matrix = orientation_tables.matrices[orientation];
+	return matrix;
+}
+
+// The orientation after turning by first and then by second.
+static int
+func ComposeOrientations(int second, int first)
+{
+	int orientation = orientation_tables.products[second][first];
+	return orientation;
+}
+
+// The entries of an orientation matrix are 0 and +-1, so rotating a point on the lattice gives an exact result.
+static V3
+func RotateByOrientation(int orientation, V3 v)
+{
+	V3 result = GetOrientationMatrix(orientation) * v;
+	return result;
+}
+
+// quarter_turn_n counterclockwise quarter turns around the axis the direction points along, see GetAxisDirection.
+static int
+func GetTurnOrientation(int axis_direction, int quarter_turn_n)
+{
+	int axis = axis_direction & 3;
+	if(axis_direction & 4) quarter_turn_n = -quarter_turn_n;
+	quarter_turn_n = ((quarter_turn_n % 4) + 4) % 4;
+
+	int orientation = IDENTITY_ORIENTATION;
+	for(int i = 0; i < quarter_turn_n; i++)
+	{
+		orientation = ComposeOrientations(orientation_tables.quarter_turns[axis], orientation);
+	}
+
+	return orientation;
+}
+
+// Where a cubie is on the corner lattice of the big cube, see GetCubeLatticePlace.
+struct CubeLatticePlace
+{
+	int grid_x;
+	int grid_y;
+	int grid_z;
+	int corner_offsets;
+	int face_directions;
+};
+
+static V3
+func GetCubeFaceNormalVector(int face_id)
+{
+	V3 normal = {};
+
+	switch(face_id)
+	{
+		case FACE_L:
+		{
+			normal = Vector3(-1, 0, 0);
+			break;
+		}
+		case FACE_R:
+		{
+			normal = Vector3(+1, 0, 0);
+			break;
+		}
+		case FACE_U:
+		{
+			normal = Vector3(0, +1, 0);
+			break;
+		}
+		case FACE_D:
+		{
+			normal = Vector3(0, -1, 0);
+			break;
+		}
+		case FACE_F:
+		{
+			normal = Vector3(0, 0, +1);
+			break;
+		}
+		case FACE_B:
+		{
+			normal = Vector3(0, 0, -1);
+			break;
+		}
+		default:
+		{
+			Assert(false);
+		}
+	}
+
+	return normal;
+}
+
+static float
+func Dot2(V2 v1, V2 v2)
+{
+	float prod = v1.x * v2.x + v1.y * v2.y;
+	return prod;
+}
+
+static float
+func Dot3(V3 v1, V3 v2)
+{
+	float prod = v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+	return prod;
+}
+
+// The corners of all cubies are points of an (N + 1) x (N + 1) x (N + 1) lattice. Everything in a rigid group,
+// the whole cube or the turning slice, goes through the same transform, which is linear in the lattice
+// coordinates. So it is enough to transform the planes of the lattice along each axis once per frame,
+// a corner is then the sum of one point from each axis.
+struct CubeLattice
+{
+	V3 *plane_points[3];
+	V3 axes[3];
+
+	// Bit per lattice edge, set when a cubie pushes the edge. Edges are numbered by their lower end point
+	// and their axis, see GetLatticeEdge.
+	unsigned int *pushed_edges;
+	int pushed_edge_word_n;
+};
+
+static int
+func GetLatticeEdgeWordN(int side_n)
+{
+	int point_n = (side_n + 1) * (side_n + 1) * (side_n + 1);
+	int word_n = (3 * point_n + 31) / 32;
+	return word_n;
+}
+
+static int
+func GetAxisDirection(V3 v)
+{
+	int axis = 0;
+	float value = v.x;
+	if(Abs(v.y) > Abs(value))
+	{
+		axis = 1;
+		value = v.y;
+	}
+	if(Abs(v.z) > Abs(value))
+	{
+		axis = 2;
+		value = v.z;
+	}
+
+	int direction = axis | ((value < 0.0f) ? 4 : 0);
+	return direction;
+}
+
+static int
+func GetGridIndex(float coord, float radius, int side_n)
+{
+	int index = (int)roundf(0.5f * (coord / radius + (float)(side_n - 1)));
+	return index;
+}
+
+// Puts the cubie on the lattice from its center and rotation. Only needed when those change,
+// that is when the cubie is created and when a turn is applied to it.
+static CubeLatticePlace
+func GetCubeLatticePlace(V3 center_base, int orientation, float radius, int side_n)
+{
+	CubeLatticePlace place = {};
+	place.grid_x = GetGridIndex(center_base.x, radius, side_n);
+	place.grid_y = GetGridIndex(center_base.y, radius, side_n);
+	place.grid_z = GetGridIndex(center_base.z, radius, side_n);
+
+	for(int corner_id = 0; corner_id < 8; corner_id++)
+	{
+		V3 corner = RotateByOrientation(orientation, unit_cube_corners[corner_id]);
+		if(corner.x > 0.0f) place.corner_offsets |= (1 << (3 * corner_id + 0));
+		if(corner.y > 0.0f) place.corner_offsets |= (1 << (3 * corner_id + 1));
+		if(corner.z > 0.0f) place.corner_offsets |= (1 << (3 * corner_id + 2));
+	}
+
+	for(int face_id = 0; face_id < 6; face_id++)
+	{
+		int direction = GetAxisDirection(RotateByOrientation(orientation, GetCubeFaceNormalVector(face_id)));
+		place.face_directions |= (direction << (3 * face_id));
+	}
+
+	return place;
+}
+
+static void
+func UpdateLattice(CubeLattice *lattice, int side_n, float radius, Quat rotations, V3 screen_center)
+{
+	PROFILE_SCOPE(PROFILE_CENTERS);
+
+	V3 base_axes[3] = {Vector3(1.0f, 0.0f, 0.0f), Vector3(0.0f, 1.0f, 0.0f), Vector3(0.0f, 0.0f, 1.0f)};
+	for(int axis = 0; axis < 3; axis++)
+	{
+		lattice->axes[axis] = QuatRotate(rotations, base_axes[axis]);
+
+		// The screen center is added to the planes of the first axis only.
+		V3 *points = lattice->plane_points[axis];
+		V3 origin = (axis == 0) ? screen_center : Vector3(0.0f, 0.0f, 0.0f);
+		for(int i = 0; i <= side_n; i++)
+		{
+			points[i] = origin + ((float)(2 * i - side_n) * radius) * lattice->axes[axis];
+		}
+	}
+
+	memset(lattice->pushed_edges, 0, lattice->pushed_edge_word_n * sizeof(unsigned int));
+}
+
+static V3
+func GetCubeCornerLatticePoint(CubeLatticePlace *place, CubeLattice *lattice, int corner_id)
+{
+	int offsets = place->corner_offsets >> (3 * corner_id);
+	V3 point = lattice->plane_points[0][place->grid_x + ((offsets >> 0) & 1)] +
+			   lattice->plane_points[1][place->grid_y + ((offsets >> 1) & 1)] +
+			   lattice->plane_points[2][place->grid_z + ((offsets >> 2) & 1)];
+	return point;
+}
+
+// The edge between two corners of a cubie, they differ in one lattice axis.
+static int
+func GetLatticeEdge(CubeLatticePlace *place, int side_n, int corner_id1, int corner_id2)
+{
+	int offsets1 = (place->corner_offsets >> (3 * corner_id1)) & 7;
+	int offsets2 = (place->corner_offsets >> (3 * corner_id2)) & 7;
+
+	int axis_bit = offsets1 ^ offsets2;
+	int axis = (axis_bit == 1) ? 0 : ((axis_bit == 2) ? 1 : 2);
+	Assert(axis_bit == (1 << axis));
+
+	int lower_offsets = offsets1 & offsets2;
+	int point_x = place->grid_x + ((lower_offsets >> 0) & 1);
+	int point_y = place->grid_y + ((lower_offsets >> 1) & 1);
+	int point_z = place->grid_z + ((lower_offsets >> 2) & 1);
+
+	int point_n_per_axis = side_n + 1;
+	int point = (point_x * point_n_per_axis + point_y) * point_n_per_axis + point_z;
+	int edge = 3 * point + axis;
+	return edge;
+}
+
+static V3
+func GetCubeFaceLatticeNormal(CubeLatticePlace *place, CubeLattice *lattice, int face_id)
+{
+	int direction = (place->face_directions >> (3 * face_id)) & 7;
+	V3 normal = lattice->axes[direction & 3];
+	if(direction & 4) normal = -normal;
+	return normal;
+}
+
+enum CubeEdgeMode
+{
+	CUBE_EDGES_ALL,
+
+	// Neighbor cubies share edges, an edge another cubie already pushed for the same lattice is skipped.
+	// That is only right with the depth test, the painter's order needs the nearer cubie to draw the edge
+	// again over its own faces.
+	CUBE_EDGES_UNSHARED,
+
+	// The outline pass finds the edges from the face ids.
+	CUBE_EDGES_NONE
+};
+
+// Bit per face in face_mask, a face is only drawn if it is on the outside of the big cube
+// or on the cut opened by the slice that is turning.
+static void
+func DrawCube(RenderList *list, CubeLatticePlace place, int face_mask, int id, float radius, int side_n,
+			  CubeLattice *lattice, CubeEdgeMode edge_mode)
+{
+	// With the orthographic projection a face is visible exactly when its normal points towards the viewer,
+	// faces turned away are dropped before any of their corners are looked up.
+	// Edge pixels are not exactly on the faces they border, so an edge is kept in front of them with
+	// a depth bias that grows with how steeply those faces go into the screen. Faces of other cubies
+	// are further away than the bias, so they still hide the edge.
+	int visible_face_mask = 0;
+	float face_depth_slopes[6] = {};
+	for(int face_id = 0; face_id < 6; face_id++)
+	{
+		if(!(face_mask & (1 << face_id))) continue;
+
+		V3 normal = GetCubeFaceLatticeNormal(&place, lattice, face_id);
+		if(normal.z > 0.0f)
+		{
+			visible_face_mask |= (1 << face_id);
+			face_depth_slopes[face_id] = sqrtf(normal.x * normal.x + normal.y * normal.y) / normal.z;
+			list->drawn_face_n++;
+			PROFILE_COUNT(PROFILE_QUADS, 1);
+		}
+		else
+		{
+			list->culled_face_n++;
+		}
+	}
+
+	if(visible_face_mask == 0)
+	{
+		PROFILE_COUNT(PROFILE_CULLED_CUBES, 1);
+		return;
+	}
+
+	V3 cube_corners[8] = {};
+	for(int corner_id = 0; corner_id < 8; corner_id++)
+	{
+		cube_corners[corner_id] = GetCubeCornerLatticePoint(&place, lattice, corner_id);
+	}
+
+	for(int face_id = 0; face_id < 6; face_id++)
+	{
+		if(!(visible_face_mask & (1 << face_id))) continue;
+
+		Quad3 q3 = {};
+		for(int face_corner_id = 0; face_corner_id < 4; face_corner_id++)
+		{
+			int corner_id = cube_face_corners[face_id][face_corner_id];
+			q3.p[face_corner_id] = cube_corners[corner_id];
+		}
+
+		unsigned int color = cube_face_colors[face_id];
+		unsigned int cube_face_id = 6 * id + face_id;
+		PushQuad3(list, q3, color, cube_face_id);
+	}
+
+	if(edge_mode == CUBE_EDGES_NONE) return;
+
+	// An edge can only be seen if one of the faces it borders is drawn.
+	RenderLine lines[12] = {};
+	int line_n = 0;
+	for(int edge_id = 0; edge_id < 12; edge_id++)
+	{
+		int edge_face_mask = (1 << cube_edge_faces[edge_id][0]) | (1 << cube_edge_faces[edge_id][1]);
+		if(!(visible_face_mask & edge_face_mask)) continue;
+
+		int corner_id1 = cube_edges[edge_id][0];
+		int corner_id2 = cube_edges[edge_id][1];
+
+		if(edge_mode == CUBE_EDGES_UNSHARED)
+		{
+			int edge = GetLatticeEdge(&place, side_n, corner_id1, corner_id2);
+			unsigned int edge_bit = 1u << (edge % 32);
+			unsigned int *edge_word = &lattice->pushed_edges[edge / 32];
+			if(*edge_word & edge_bit) continue;
+
+			*edge_word |= edge_bit;
+		}
+
+		V3 corner1 = cube_corners[corner_id1];
+		V3 corner2 = cube_corners[corner_id2];
+
+		float slope1 = face_depth_slopes[cube_edge_faces[edge_id][0]];
+		float slope2 = face_depth_slopes[cube_edge_faces[edge_id][1]];
+		float slope = (slope1 > slope2) ? slope1 : slope2;
+
+		float depth_bias = 2.0f + 3.0f * slope;
+		if(depth_bias > 0.5f * radius) depth_bias = 0.5f * radius;
+
+		RenderLine *line = &lines[line_n];
+		line_n++;
+
+		line->p1 = corner1;
+		line->p2 = corner2;
+		line->depth_bias = depth_bias;
+	}
+
+	unsigned int edge_color = 0x000000;
+	PushLines3(list, lines, line_n, edge_color);
+}
+
+static V3
+func CrossProduct(V3 v1, V3 v2)
+{
+	/*
+	   x    y    z
+	v1.x v1.y v1.z
+	v2.x v2.y v2.z
+	*/
+
+	V3 result = {};
+	result.x = v1.y * v2.z - v1.z * v2.y;
+	result.y = v1.z * v2.x - v1.x * v2.z;
+	result.z = v1.x * v2.y - v1.y * v2.x;
+	return result;
+}
+
+static bool
+func IsRightHandedSystem(V3 x, V3 y, V3 z)
+{
+	V3 cross_xy = CrossProduct(x, y);
+	float dot = Dot3(cross_xy, z);
+	bool is_right_handed = (dot > 0.0f);
+	return is_right_handed;
+}
+
+static V3
+func ShiftVector(V3 v)
+{
+	V3 r = {};
+	r.y = v.x;
+	r.z = v.y;
+	r.x = v.z;
+	return r;
+}
+
+#define MIN_CUBE_SIDE_N 2
+#define MAX_CUBE_SIDE_N 100
+#define DEFAULT_CUBE_SIDE_N 3
+
+// Only cubies on the outside of the big cube are stored, turns move them around but never inside.
+// While a slice turns, interior cubies next to the cut are added after the surface ones for that frame.
+// Cubies are stored as one array per field, so a loop over all of them only loads the fields it uses.
+// A cubie never changes its index, the painter's order is kept as an array of indices.
+struct BigCube
+{
+	Quat rotations;
+
+	int cube_n;
+	int surface_cube_n;
+	int side_n;
+	float cube_radius;
+
+	V3Array centers_base;
+	V3Array centers_final;
+	unsigned char *cube_orientations;
+	int *cube_ids;
+	bool *cube_is_rotating;
+	int *sticker_face_masks;
+	int *cut_face_masks;
+	CubeLatticePlace *lattice_places;
+
+	// Cubie indices in drawing order, and room to sort them. Without a turn the order only depends on
+	// which way the lattice axes point, sorted_view remembers that for the order in draw_order, 0 if unknown.
+	int *draw_order;
+	int *sort_scratch;
+	int *sort_counts;
+	int sorted_view;
+
+	CubeLattice static_lattice;
+	CubeLattice turning_lattice;
+};
+
+static float
+func GetGridOffset(int side_n, int index)
+{
+	float offset = (-side_n + 1.0f) + (2.0f * index);
+	return offset;
+}
+
+static bool
+func IsSurfaceIndex(int side_n, int index)
+{
+	bool is_surface = (index == 0 || index == side_n - 1);
+	return is_surface;
+}
+
+// Surface cubies are created in id order and never move in the arrays, so a cubie is found from its id directly.
+static int
+func GetCubeIndex(BigCube *big_cube, int id)
+{
+	int index = id - 1;
+	Assert(index >= 0 && index < big_cube->surface_cube_n);
+	Assert(big_cube->cube_ids[index] == id);
+	return index;
+}
+
+// Appends a cubie, it is drawn after every cubie already in the draw order.
+static int
+func AddCube(BigCube *big_cube, int id, V3 center_base, int orientation, int sticker_face_mask, int cut_face_mask)
+{
+	int index = big_cube->cube_n;
+	big_cube->cube_n++;
+
+	SetArrayPoint(big_cube->centers_base, index, center_base);
+	SetArrayPoint(big_cube->centers_final, index, center_base);
+	big_cube->cube_orientations[index] = (unsigned char)orientation;
+	big_cube->cube_ids[index] = id;
+	big_cube->cube_is_rotating[index] = false;
+	big_cube->sticker_face_masks[index] = sticker_face_mask;
+	big_cube->cut_face_masks[index] = cut_face_mask;
+	big_cube->lattice_places[index] = GetCubeLatticePlace(center_base, orientation, big_cube->cube_radius, big_cube->side_n);
+	big_cube->draw_order[index] = index;
+
+	return index;
+}
+
+// The cubies live in the arena, building a cube of a different size reuses its memory.
+static void
+func InitBigCube(BigCube *big_cube, MemArena *arena, int side_n, float side_radius)
+{
+	Assert(side_n >= MIN_CUBE_SIDE_N && side_n <= MAX_CUBE_SIDE_N);
+
+	float small_side_radius = side_radius / (float)side_n;
+
+	int inner_side_n = side_n - 2;
+	int surface_cube_n = side_n * side_n * side_n - inner_side_n * inner_side_n * inner_side_n;
+	int max_cut_cube_n = 3 * inner_side_n * inner_side_n;
+	int max_cube_n = surface_cube_n + max_cut_cube_n;
+	int lattice_point_n = 6 * (side_n + 1);
+
+	size_t cube_size = 6 * sizeof(float) + sizeof(unsigned char) + sizeof(int) + sizeof(bool) + 2 * sizeof(int) +
+					   sizeof(CubeLatticePlace) + 2 * sizeof(int);
+	int array_n = 15 + 6 + 2;
+	int edge_word_n = GetLatticeEdgeWordN(side_n);
+	ReserveArena(arena, max_cube_n * cube_size + (side_n + 1) * sizeof(int) + lattice_point_n * sizeof(V3) +
+				 2 * edge_word_n * sizeof(unsigned int) + array_n * ARENA_ALIGNMENT);
+
+	*big_cube = {};
+	big_cube->centers_base.x = ArenaPushArray(arena, max_cube_n, float);
+	big_cube->centers_base.y = ArenaPushArray(arena, max_cube_n, float);
+	big_cube->centers_base.z = ArenaPushArray(arena, max_cube_n, float);
+	big_cube->centers_final.x = ArenaPushArray(arena, max_cube_n, float);
+	big_cube->centers_final.y = ArenaPushArray(arena, max_cube_n, float);
+	big_cube->centers_final.z = ArenaPushArray(arena, max_cube_n, float);
+	big_cube->cube_orientations = ArenaPushArray(arena, max_cube_n, unsigned char);
+	big_cube->cube_ids = ArenaPushArray(arena, max_cube_n, int);
+	big_cube->cube_is_rotating = ArenaPushArray(arena, max_cube_n, bool);
+	big_cube->sticker_face_masks = ArenaPushArray(arena, max_cube_n, int);
+	big_cube->cut_face_masks = ArenaPushArray(arena, max_cube_n, int);
+	big_cube->lattice_places = ArenaPushArray(arena, max_cube_n, CubeLatticePlace);
+	big_cube->draw_order = ArenaPushArray(arena, max_cube_n, int);
+	big_cube->sort_scratch = ArenaPushArray(arena, max_cube_n, int);
+	big_cube->sort_counts = ArenaPushArray(arena, side_n + 1, int);
+	for(int axis = 0; axis < 3; axis++)
+	{
+		big_cube->static_lattice.plane_points[axis] = ArenaPushArray(arena, side_n + 1, V3);
+		big_cube->turning_lattice.plane_points[axis] = ArenaPushArray(arena, side_n + 1, V3);
+	}
+	big_cube->static_lattice.pushed_edges = ArenaPushArray(arena, edge_word_n, unsigned int);
+	big_cube->static_lattice.pushed_edge_word_n = edge_word_n;
+	big_cube->turning_lattice.pushed_edges = ArenaPushArray(arena, edge_word_n, unsigned int);
+	big_cube->turning_lattice.pushed_edge_word_n = edge_word_n;
+	big_cube->surface_cube_n = surface_cube_n;
+	big_cube->side_n = side_n;
+	big_cube->cube_radius = small_side_radius;
+	big_cube->rotations = GetIdentityRotationQuat();
+
+	for(int x = 0; x < side_n; x++)
+	{
+		for(int y = 0; y < side_n; y++)
+		{
+			for(int z = 0; z < side_n; z++)
+			{
+				int sticker_face_mask = 0;
+				if(x == 0)          sticker_face_mask |= (1 << FACE_L);
+				if(x == side_n - 1) sticker_face_mask |= (1 << FACE_R);
+				if(y == 0)          sticker_face_mask |= (1 << FACE_D);
+				if(y == side_n - 1) sticker_face_mask |= (1 << FACE_U);
+				if(z == 0)          sticker_face_mask |= (1 << FACE_B);
+				if(z == side_n - 1) sticker_face_mask |= (1 << FACE_F);
+
+				if(sticker_face_mask == 0) continue;
+
+				V3 offset = Vector3(GetGridOffset(side_n, x), GetGridOffset(side_n, y), GetGridOffset(side_n, z));
+				AddCube(big_cube, big_cube->cube_n + 1, small_side_radius * offset, IDENTITY_ORIENTATION, sticker_face_mask, 0);
+			}
+		}
+	}
+	Assert(big_cube->cube_n == surface_cube_n);
+}
+
+static void
+func DrawCubeAt(RenderList *list, BigCube *big_cube, int index, CubeLattice *lattice, CubeEdgeMode edge_mode)
+{
+	int face_mask = big_cube->sticker_face_masks[index] | big_cube->cut_face_masks[index];
+	DrawCube(list, big_cube->lattice_places[index], face_mask, big_cube->cube_ids[index], big_cube->cube_radius,
+			 big_cube->side_n, lattice, edge_mode);
+}
+
+enum CubeSelection
+{
+	CUBES_ALL,
+	CUBES_STATIC,
+	CUBES_TURNING
+};
+
+// Pushes the selected cubies in draw order, cubies of the turning slice go on the turning lattice.
+static void
+func PushCubes(RenderList *list, BigCube *big_cube, CubeSelection selection, CubeEdgeMode edge_mode)
+{
+	PROFILE_SCOPE(PROFILE_PUSH);
+
+	for(int i = 0; i < big_cube->cube_n; i++)
+	{
+		int index = big_cube->draw_order[i];
+		bool is_rotating = big_cube->cube_is_rotating[index];
+		if(selection == CUBES_STATIC && is_rotating) continue;
+		if(selection == CUBES_TURNING && !is_rotating) continue;
+
+		CubeLattice *lattice = is_rotating ? &big_cube->turning_lattice : &big_cube->static_lattice;
+		DrawCubeAt(list, big_cube, index, lattice, edge_mode);
+	}
+}
+
+// Position of a cubie along a lattice axis, counted from the end of the big cube that is further from the viewer.
+static int
+func GetCubeFarToNearRank(BigCube *big_cube, int index, int axis, CubeLattice *lattice)
+{
+	CubeLatticePlace *place = &big_cube->lattice_places[index];
+	int grid_index = (axis == 0) ? place->grid_x : ((axis == 1) ? place->grid_y : place->grid_z);
+
+	int rank = (lattice->axes[axis].z >= 0.0f) ? grid_index : (big_cube->side_n - 1 - grid_index);
+	return rank;
+}
+
+// Painter's order in linear time. With the orthographic projection, a cubie can only hide cubies that are not
+// nearer to the viewer than it along any lattice axis, so walking a rigid group of cubies axis by axis, each axis
+// from its far end, draws hidden cubies first. During a turn the outer axis is the turn axis: the layers along it
+// are separated by planes the turning slice does not cross, so the layers go far to near, and the cubies inside
+// a layer are ordered by the lattice of their own group.
+// The walk is done as three stable counting sorts over the draw order, the innermost axis first.
+static void
+func SortCubes(BigCube *big_cube, int turn_axis)
+{
+	PROFILE_SCOPE(PROFILE_SORT);
+
+	CubeLattice *static_lattice = &big_cube->static_lattice;
+	CubeLattice *turning_lattice = &big_cube->turning_lattice;
+
+	bool is_turning = (turn_axis >= 0);
+	int outer_axis = is_turning ? turn_axis : 0;
+
+	int view = 1;
+	for(int axis = 0; axis < 3; axis++)
+	{
+		if(static_lattice->axes[axis].z >= 0.0f) view |= (2 << axis);
+	}
+
+	if(!is_turning && big_cube->sorted_view == view) return;
+
+	int side_n = big_cube->side_n;
+	int sort_axes[3] = {(outer_axis + 2) % 3, (outer_axis + 1) % 3, outer_axis};
+	for(int pass = 0; pass < 3; pass++)
+	{
+		int axis = sort_axes[pass];
+		int *order = big_cube->draw_order;
+		int *sorted_order = big_cube->sort_scratch;
+		int *counts = big_cube->sort_counts;
+
+		memset(counts, 0, (side_n + 1) * sizeof(int));
+		for(int i = 0; i < big_cube->cube_n; i++)
+		{
+			int index = order[i];
+			bool use_turning_lattice = (big_cube->cube_is_rotating[index] && axis != outer_axis);
+			CubeLattice *lattice = use_turning_lattice ? turning_lattice : static_lattice;
+			counts[GetCubeFarToNearRank(big_cube, index, axis, lattice) + 1]++;
+		}
+
+		for(int rank = 1; rank <= side_n; rank++)
+		{
+			counts[rank] += counts[rank - 1];
+		}
+
+		for(int i = 0; i < big_cube->cube_n; i++)
+		{
+			int index = order[i];
+			bool use_turning_lattice = (big_cube->cube_is_rotating[index] && axis != outer_axis);
+			CubeLattice *lattice = use_turning_lattice ? turning_lattice : static_lattice;
+			int rank = GetCubeFarToNearRank(big_cube, index, axis, lattice);
+
+			sorted_order[counts[rank]] = index;
+			counts[rank]++;
+		}
+
+		big_cube->draw_order = sorted_order;
+		big_cube->sort_scratch = order;
+	}
+
+	big_cube->sorted_view = is_turning ? 0 : view;
+}
+
+// Faces of a cubie on the cut planes of the turning slice, layer is -1, 0 or +1 relative to the slice along axis.
+static int
+func GetCutFaceMask(int orientation, V3 axis, int layer)
+{
+	int face_mask = 0;
+	for(int face_id = 0; face_id < 6; face_id++)
+	{
+		float side = Dot3(RotateByOrientation(orientation, GetCubeFaceNormalVector(face_id)), axis);
+
+		bool on_cut = false;
+		if(layer == 0) on_cut = (Abs(side) > 0.5f);
+		else if(layer == -1) on_cut = (side > 0.5f);
+		else if(layer == +1) on_cut = (side < -0.5f);
+
+		if(on_cut) face_mask |= (1 << face_id);
+	}
+
+	return face_mask;
+}
+
+// Opens the cut around the turning slice: surface cubies next to it get their cut faces,
+// and the interior cubies of the slice and its two neighbor layers are added as cut cubies.
+static void
+func AddCutCubes(BigCube *big_cube, V3 rotation_axis_base, V3 slice_center_base,
+				 Quat side_rotation, V3 screen_center)
+{
+	PROFILE_SCOPE(PROFILE_CENTERS);
+	Assert(big_cube->cube_n == big_cube->surface_cube_n);
+
+	int side_n = big_cube->side_n;
+	float radius = big_cube->cube_radius;
+
+	V3 axis = Vector3(roundf(Abs(rotation_axis_base.x)), roundf(Abs(rotation_axis_base.y)), roundf(Abs(rotation_axis_base.z)));
+	float slice_distance = Dot3(slice_center_base, axis);
+
+	for(int i = 0; i < big_cube->cube_n; i++)
+	{
+		int layer = (int)roundf((Dot3(GetArrayPoint(big_cube->centers_base, i), axis) - slice_distance) / (2.0f * radius));
+		if(layer >= -1 && layer <= +1)
+		{
+			big_cube->cut_face_masks[i] = GetCutFaceMask(big_cube->cube_orientations[i], axis, layer);
+		}
+	}
+
+	V3 axis_u = ShiftVector(axis);
+	V3 axis_v = ShiftVector(axis_u);
+
+	M3x3 static_rotation = QuatToMatrix(big_cube->rotations);
+	M3x3 turning_rotation = QuatToMatrix(big_cube->rotations * side_rotation);
+	int slice_index = (int)roundf(0.5f * (slice_distance / radius + (float)(side_n - 1)));
+
+	for(int layer = -1; layer <= +1; layer++)
+	{
+		int layer_index = slice_index + layer;
+		if(layer_index < 1 || layer_index > side_n - 2) continue;
+
+		int cut_face_mask = GetCutFaceMask(IDENTITY_ORIENTATION, axis, layer);
+		for(int u = 1; u <= side_n - 2; u++)
+		{
+			for(int v = 1; v <= side_n - 2; v++)
+			{
+				V3 offset = GetGridOffset(side_n, layer_index) * axis +
+							GetGridOffset(side_n, u) * axis_u +
+							GetGridOffset(side_n, v) * axis_v;
+				V3 center_base = radius * offset;
+
+				// Id 0 is what the background has, cut cubies cannot be grabbed.
+				int index = AddCube(big_cube, 0, center_base, IDENTITY_ORIENTATION, 0, cut_face_mask);
+
+				bool is_rotating = (layer == 0);
+				big_cube->cube_is_rotating[index] = is_rotating;
+
+				M3x3 rotation = is_rotating ? turning_rotation : static_rotation;
+				SetArrayPoint(big_cube->centers_final, index, screen_center + rotation * center_base);
+			}
+		}
+	}
+}
+
+// center_final of every cubie, ignoring side turns.
+static void
+func UpdateCubeCenters(BigCube *big_cube, V3 screen_center)
+{
+	PROFILE_SCOPE(PROFILE_CENTERS);
+
+	M3x3 rotation = QuatToMatrix(big_cube->rotations);
+	TransformPoints(rotation, screen_center, big_cube->centers_base, big_cube->centers_final, big_cube->cube_n);
+}
+
+// Drops the cut cubies again, keeping the order of the surface cubies for the next sort.
+static void
+func RemoveCutCubes(BigCube *big_cube)
+{
+	int order_n = 0;
+	for(int i = 0; i < big_cube->cube_n; i++)
+	{
+		int index = big_cube->draw_order[i];
+		if(index >= big_cube->surface_cube_n) continue;
+
+		big_cube->draw_order[order_n] = index;
+		order_n++;
+	}
+
+	Assert(order_n == big_cube->surface_cube_n);
+	big_cube->cube_n = big_cube->surface_cube_n;
+	memset(big_cube->cut_face_masks, 0, big_cube->cube_n * sizeof(int));
+}
+
+struct CubePick
+{
+	bool hit;
+	int cube_id;
+	int face_id;
+	V3 hit_point;
+};
+
+// Intersects the view ray through a screen point with the drawn faces of the cubies and returns the closest hit.
+// The projection is orthographic, so the ray goes straight into the screen along z.
+static CubePick
+func PickCube(BigCube *big_cube, Quat side_rotation_quat, V2 point)
+{
+	PROFILE_SCOPE(PROFILE_PICK);
+
+	// A cubie is turned by its orientation and then by the static or the turning transform,
+	// so there are only 2 * 24 different rotations to compute.
+	M3x3 transforms[2] = {QuatToMatrix(big_cube->rotations), QuatToMatrix(side_rotation_quat)};
+	M3x3 cube_rotations[2][ORIENTATION_N] = {};
+	for(int transform_id = 0; transform_id < 2; transform_id++)
+	{
+		for(int orientation = 0; orientation < ORIENTATION_N; orientation++)
+		{
+			cube_rotations[transform_id][orientation] = transforms[transform_id] * GetOrientationMatrix(orientation);
+		}
+	}
+
+	CubePick pick = {};
+	for(int i = 0; i < big_cube->cube_n; i++)
+	{
+		M3x3 cube_rotation = cube_rotations[big_cube->cube_is_rotating[i] ? 1 : 0][big_cube->cube_orientations[i]];
+		V3 center_final = GetArrayPoint(big_cube->centers_final, i);
+
+		V3 axes[3] =
+		{
+			cube_rotation * Vector3(1.0f, 0.0f, 0.0f),
+			cube_rotation * Vector3(0.0f, 1.0f, 0.0f),
+			cube_rotation * Vector3(0.0f, 0.0f, 1.0f)
+		};
+
+		int face_mask = big_cube->sticker_face_masks[i] | big_cube->cut_face_masks[i];
+		for(int face_id = 0; face_id < 6; face_id++)
+		{
+			if(!(face_mask & (1 << face_id))) continue;
+
+			V3 normal = cube_rotation * GetCubeFaceNormalVector(face_id);
+			if(normal.z <= 0.0f) continue;
+
+			V3 face_center = center_final + big_cube->cube_radius * normal;
+			float z = face_center.z - (normal.x * (point.x - face_center.x) + normal.y * (point.y - face_center.y)) / normal.z;
+			if(pick.hit && z <= pick.hit_point.z) continue;
+
+			// The hit point is on the plane of the face, it is on the face if it is inside the cubie.
+			V3 hit_point = Point3(point.x, point.y, z);
+			V3 offset = hit_point - center_final;
+			float max_distance = 1.0001f * big_cube->cube_radius;
+
+			bool is_inside = true;
+			for(int axis_id = 0; axis_id < 3; axis_id++)
+			{
+				if(Abs(Dot3(offset, axes[axis_id])) > max_distance) is_inside = false;
+			}
+
+			if(is_inside)
+			{
+				pick.hit = true;
+				pick.cube_id = big_cube->cube_ids[i];
+				pick.face_id = face_id;
+				pick.hit_point = hit_point;
+			}
+		}
+	}
+
+	return pick;
+}
+
+struct Input
+{
+	V2 mouse_position;
+	bool left_mouse_button_down;
+	bool right_mouse_button_down;
+};
+
+struct Scene
+{
+	MemArena cube_arena;
+	BigCube big_cube;
+	float side_radius;
+
+	// The scene is laid out in window pixels and drawn into a buffer render_scale times that size.
+	float render_scale;
+
+	bool is_rotating;
+	bool big_cube_rotation;
+
+	int rotating_cube_id;
+	int rotating_face_id;
+	V2 clicked_pixel;
+	V3 rotation1_vector;
+	V3 rotation2_vector;
+	V2 rotation1_vector_pixel;
+	V2 rotation2_vector_pixel;
+
+	V2 prev_mouse_position;
+
+	// Cubies that stay in place during a slice turn, drawn when the turn starts. It is only valid
+	// for the slice turning around the axis it was drawn for.
+	Buffer static_layer;
+	bool static_layer_is_valid;
+	float static_layer_scale;
+	int static_layer_cube_id;
+	V3 static_layer_axis;
+};
+
+static void
+func InitScene(Scene *scene, int side_n, float side_radius)
+{
+	*scene = {};
+	scene->side_radius = side_radius;
+	scene->render_scale = 1.0f;
+	InitBigCube(&scene->big_cube, &scene->cube_arena, side_n, side_radius);
+}
+
+// Rebuilds the big cube solved with side_n cubies along each side, the view rotation is kept.
+static void
+func ResizeSceneCube(Scene *scene, int side_n)
+{
+	if(side_n < MIN_CUBE_SIDE_N) side_n = MIN_CUBE_SIDE_N;
+	if(side_n > MAX_CUBE_SIDE_N) side_n = MAX_CUBE_SIDE_N;
+
+	Quat rotations = scene->big_cube.rotations;
+	InitBigCube(&scene->big_cube, &scene->cube_arena, side_n, scene->side_radius);
+	scene->big_cube.rotations = rotations;
+
+	scene->is_rotating = false;
+	scene->big_cube_rotation = false;
+}
+
+static void
+func FreeScene(Scene *scene)
+{
+	FreeArena(&scene->cube_arena);
+	FreeBuffer(&scene->static_layer);
+	*scene = {};
+}
+
+static float
+func RoundToHalfPi(float x)
+{
+	float half_pi = 0.5f * 3.141592653589793238462643383f;
+	float rounded_x = x;
+
+	int times = (int)(x / half_pi);
+
+	float low = (float)times * half_pi;
+	if(x < 0) low -= half_pi;
+
+	float high = low + half_pi;
+	Assert(low <= x);
+	Assert(x <= high);
+
+	float low_abs = x - low;
+	float high_abs = high - x;
+	if(low_abs < high_abs) rounded_x = low;
+	else rounded_x = high;
+
+	return rounded_x;
+}
+
+// How many counterclockwise quarter turns an angle snaps to, from 0 to 3.
+static int
+func GetQuarterTurnN(float theta)
+{
+	float half_pi = 0.5f * 3.141592653589793238462643383f;
+	int quarter_turn_n = (int)roundf(RoundToHalfPi(theta) / half_pi);
+	quarter_turn_n = ((quarter_turn_n % 4) + 4) % 4;
+	return quarter_turn_n;
+}
+
+static void
+func DrawScene(Buffer *buffer, TileRenderer *renderer, Scene *scene, Input input)
+{
+	BigCube *big_cube = &scene->big_cube;
+	V2 mouse_position = input.mouse_position;
+
+	bool is_side_rotating = (scene->is_rotating && !scene->big_cube_rotation);
+
+	V2 mouse_position_diff = mouse_position - scene->prev_mouse_position;
+
+	scene->prev_mouse_position = mouse_position;
+
+	if(scene->is_rotating && scene->big_cube_rotation)
+	{
+		float theta_y = mouse_position_diff.x / 100.0f;
+		V3 y_axis = Vector3(0.0f, 1.0f, 0.0f);
+		Quat quat_y = GetRotationQuat(y_axis, theta_y);
+
+		float theta_x = (-mouse_position_diff.y) / 100.0f;
+		V3 x_axis = Vector3(1.0f, 0.0f, 0.0f);
+		Quat quat_x = GetRotationQuat(x_axis, theta_x);
+
+	
+		big_cube->rotations = quat_x * quat_y * big_cube->rotations;
+	}
+
+	float render_scale = scene->render_scale;
+	V3 screen_center = 0.5f * Point3((float)buffer->width / render_scale, (float)buffer->height / render_scale, 0.0f);
+	UpdateCubeCenters(big_cube, screen_center);
+
+	for(int i = 0; i < big_cube->cube_n; i++)
+	{
+		big_cube->cube_is_rotating[i] = false;
+	}
+
+	Quat side_rotation = GetIdentityRotationQuat();
+	int turn_axis = -1;
+	V3 rotation_vector = Vector3(0, 0, 0);
+	V3 rotation_perp_vector = Vector3(0, 0, 0);
+	if(is_side_rotating)
+	{
+		Assert(!input.right_mouse_button_down);
+
+		V2 mouse_diff = mouse_position - scene->clicked_pixel;
+		float rotation1_distance = Dot2(mouse_diff, scene->rotation1_vector_pixel);
+		float rotation2_distance = Dot2(mouse_diff, scene->rotation2_vector_pixel);
+
+		bool use_rotation1 = (Abs(rotation1_distance) > Abs(rotation2_distance));
+
+		V3 rotation_vector_base = use_rotation1 ? scene->rotation1_vector : scene->rotation2_vector;
+		V3 rotation_perp_vector_base = use_rotation1 ? scene->rotation2_vector : -scene->rotation1_vector;
+
+		rotation_vector = QuatRotate(big_cube->rotations, rotation_vector_base);
+		rotation_perp_vector = QuatRotate(big_cube->rotations, rotation_perp_vector_base);
+
+		float rotation_distance = use_rotation1 ? rotation1_distance : rotation2_distance;
+		float theta = rotation_distance / 50.0f;
+
+		side_rotation = GetRotationQuat(rotation_perp_vector_base, theta);
+
+		int rotating_index = GetCubeIndex(big_cube, scene->rotating_cube_id);
+		float cube_radius = big_cube->cube_radius;
+
+		M3x3 turning_rotation = QuatToMatrix(big_cube->rotations * side_rotation);
+		float base_perp_distance = Dot3(GetArrayPoint(big_cube->centers_final, rotating_index), rotation_perp_vector);
+		for(int i = 0; i < big_cube->cube_n; i++)
+		{
+			float perp_distance = Dot3(GetArrayPoint(big_cube->centers_final, i), rotation_perp_vector);
+			if(Abs(perp_distance - base_perp_distance) < cube_radius)
+			{
+				big_cube->cube_is_rotating[i] = true;
+
+				V3 center_base = GetArrayPoint(big_cube->centers_base, i);
+				SetArrayPoint(big_cube->centers_final, i, screen_center + turning_rotation * center_base);
+			}
+			else
+			{
+				big_cube->cube_is_rotating[i] = false;
+			}
+		}
+
+		if(!input.left_mouse_button_down)
+		{
+			int turn_direction = GetAxisDirection(rotation_perp_vector_base);
+			int turn_orientation = GetTurnOrientation(turn_direction, GetQuarterTurnN(theta));
+			for(int i = 0; i < big_cube->cube_n; i++)
+			{
+				if(big_cube->cube_is_rotating[i])
+				{
+					int orientation = ComposeOrientations(turn_orientation, big_cube->cube_orientations[i]);
+					V3 center_base = RotateByOrientation(turn_orientation, GetArrayPoint(big_cube->centers_base, i));
+
+					big_cube->cube_orientations[i] = (unsigned char)orientation;
+					SetArrayPoint(big_cube->centers_base, i, center_base);
+					big_cube->lattice_places[i] = GetCubeLatticePlace(center_base, orientation, cube_radius, big_cube->side_n);
+					big_cube->cube_is_rotating[i] = false;
+				}
+			}
+			big_cube->sorted_view = 0;
+
+			side_rotation = GetIdentityRotationQuat();
+			scene->is_rotating = false;
+		}
+		else
+		{
+			turn_axis = GetAxisDirection(rotation_perp_vector_base) & 3;
+
+			V3 slice_center_base = GetArrayPoint(big_cube->centers_base, rotating_index);
+			AddCutCubes(big_cube, rotation_perp_vector_base, slice_center_base, side_rotation, screen_center);
+		}
+	}
+
+	Quat side_rotation_quat = big_cube->rotations * side_rotation;
+	unsigned int background_color = 0xAAAAAA;
+
+	float cube_radius = big_cube->cube_radius;
+	UpdateLattice(&big_cube->static_lattice, big_cube->side_n, cube_radius, big_cube->rotations, screen_center);
+	UpdateLattice(&big_cube->turning_lattice, big_cube->side_n, cube_radius, side_rotation_quat, screen_center);
+
+	CubeEdgeMode edge_mode = CUBE_EDGES_ALL;
+	if(buffer->outline_thickness > 0) edge_mode = CUBE_EDGES_NONE;
+	else if(buffer->depth_test) edge_mode = CUBE_EDGES_UNSHARED;
+
+	// While a slice turns, the rest of the cube does not move. With the depth test on, it is drawn into
+	// the static layer once and every frame of the turn starts from a copy of it, only the slice is drawn again.
+	bool use_static_layer = (buffer->depth_test && scene->is_rotating && !scene->big_cube_rotation);
+	if(use_static_layer)
+	{
+		Buffer *static_layer = &scene->static_layer;
+
+		bool is_valid = scene->static_layer_is_valid &&
+						static_layer->width == buffer->width && static_layer->height == buffer->height &&
+						static_layer->store_cube_face_ids == buffer->store_cube_face_ids &&
+						static_layer->use_palette == buffer->use_palette &&
+						static_layer->outline_thickness == buffer->outline_thickness &&
+						static_layer->outline_color == buffer->outline_color &&
+						scene->static_layer_scale == render_scale &&
+						scene->static_layer_cube_id == scene->rotating_cube_id &&
+						scene->static_layer_axis.x == rotation_perp_vector.x &&
+						scene->static_layer_axis.y == rotation_perp_vector.y &&
+						scene->static_layer_axis.z == rotation_perp_vector.z;
+		if(!is_valid)
+		{
+			if(static_layer->width != buffer->width || static_layer->height != buffer->height ||
+			   static_layer->store_cube_face_ids != buffer->store_cube_face_ids ||
+			   static_layer->use_palette != buffer->use_palette || !static_layer->depth_test)
+			{
+				static_layer->depth_test = true;
+				static_layer->store_cube_face_ids = buffer->store_cube_face_ids;
+				static_layer->use_palette = buffer->use_palette;
+				ResizeBuffer(static_layer, buffer->width, buffer->height);
+			}
+			static_layer->outline_thickness = buffer->outline_thickness;
+			static_layer->outline_color = buffer->outline_color;
+
+			ResetRenderList(&renderer->list, render_scale);
+			PushCubes(&renderer->list, big_cube, CUBES_STATIC, edge_mode);
+
+			RenderTiles(renderer, static_layer, background_color);
+
+			scene->static_layer_is_valid = true;
+			scene->static_layer_scale = render_scale;
+			scene->static_layer_cube_id = scene->rotating_cube_id;
+			scene->static_layer_axis = rotation_perp_vector;
+		}
+
+		ResetRenderList(&renderer->list, render_scale);
+		PushCubes(&renderer->list, big_cube, CUBES_TURNING, edge_mode);
+
+		RenderTilesOnLayer(renderer, buffer, static_layer);
+	}
+	else
+	{
+		scene->static_layer_is_valid = false;
+
+		// The depth test resolves visibility per pixel, the draw order only matters without it.
+		if(!buffer->depth_test) SortCubes(big_cube, turn_axis);
+
+		ResetRenderList(&renderer->list, render_scale);
+		PushCubes(&renderer->list, big_cube, CUBES_ALL, edge_mode);
+
+		RenderTiles(renderer, buffer, background_color);
+	}
+
+	RemoveCutCubes(big_cube);
+
+	CubePick pick = PickCube(big_cube, side_rotation_quat, mouse_position);
+	int picked_cube_id = pick.cube_id;
+	int picked_face_id = pick.face_id;
+
+	// Cut cubies are gone again, so a hit is always on a surface cubie.
+	int index_at_mouse = pick.hit ? GetCubeIndex(big_cube, picked_cube_id) : -1;
+
+	if(!input.left_mouse_button_down)
+	{
+		scene->is_rotating = false;
+	}
+	else if(!scene->is_rotating)
+	{
+		scene->is_rotating = true;
+		if(index_at_mouse < 0)
+		{
+			scene->big_cube_rotation = true;
+		}
+		else
+		{
+			scene->big_cube_rotation = false;
+			scene->rotating_cube_id = picked_cube_id;
+			scene->rotating_face_id = picked_face_id;
+
+			scene->clicked_pixel = mouse_position;
+
+			int orientation_at_mouse = big_cube->cube_orientations[index_at_mouse];
+			V3 face_normal = RotateByOrientation(orientation_at_mouse, GetCubeFaceNormalVector(scene->rotating_face_id));
+
+			scene->rotation1_vector = ShiftVector(face_normal);
+			scene->rotation2_vector = ShiftVector(scene->rotation1_vector);
+
+			if(!IsRightHandedSystem(face_normal, scene->rotation1_vector, scene->rotation2_vector))
+			{
+				scene->rotation2_vector = -scene->rotation2_vector;
+			}
+			Assert(IsRightHandedSystem(face_normal, scene->rotation1_vector, scene->rotation2_vector));
+
+			scene->rotation1_vector_pixel = ProjectToScreen(QuatRotate(big_cube->rotations, scene->rotation1_vector));
+			scene->rotation2_vector_pixel = ProjectToScreen(QuatRotate(big_cube->rotations, scene->rotation2_vector));
+		}
+	}
+}
@@ -0,0 +1,961 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Wide tiles keep each cleared and filled row segment long, narrow 64x64 tiles spend most of the clear on
+// jumping between rows of the buffer.
+#define TILE_WIDTH 256
+#define TILE_HEIGHT 32
+
+// Damage rects that are left apart before they are merged anyway, every one of them is a separate upload.
+#define MAX_DAMAGE_RECT_N 32
+
+enum RenderCommandKind
+{
+	RENDER_COMMAND_QUAD,
+	RENDER_COMMAND_LINES
+};
+
+struct RenderLine
+{
+	V3 p1;
+	V3 p2;
+	float depth_bias;
+};
+
+// A lines command draws line_n lines of the render list starting at first_line, all in the same color.
+// Commands with the same hash draw the same pixels. color_index is only set for buffers with a palette.
+struct RenderCommand
+{
+	int kind;
+	unsigned int color;
+	unsigned int color_index;
+	unsigned int cube_face_id;
+	Quad3 quad;
+	int first_line;
+	int line_n;
+	ClipRect bounds;
+	unsigned int hash;
+};
+
+struct RenderList
+{
+	RenderCommand *commands;
+	int command_n;
+	int command_capacity;
+
+	RenderLine *lines;
+	int line_n;
+	int line_capacity;
+
+	// Faces dropped for pointing away from the viewer and faces pushed since the last reset.
+	int culled_face_n;
+	int drawn_face_n;
+
+	// Buffer pixels per scene pixel, pushed points are scaled by it.
+	float scale;
+};
+
+static void
+func ResetRenderList(RenderList *list, float scale)
+{
+	list->scale = scale;
+	list->command_n = 0;
+	list->line_n = 0;
+	list->culled_face_n = 0;
+	list->drawn_face_n = 0;
+}
+
+static RenderCommand *
+func PushRenderCommand(RenderList *list)
+{
+	if(list->command_n == list->command_capacity)
+	{
+		int new_capacity = (list->command_capacity > 0) ? 2 * list->command_capacity : 1024;
+		RenderCommand *new_commands = new RenderCommand[new_capacity];
+		for(int i = 0; i < list->command_n; i++) new_commands[i] = list->commands[i];
+
+		delete[] list->commands;
+		list->commands = new_commands;
+		list->command_capacity = new_capacity;
+	}
+
+	RenderCommand *command = &list->commands[list->command_n];
+	list->command_n++;
+
+	*command = {};
+	return command;
+}
+
+// FNV-1a over 32-bit words.
+static unsigned int
+func HashWords(unsigned int hash, const void *data, size_t size)
+{
+	const unsigned int *words = (const unsigned int *)data;
+	for(size_t i = 0; i < size / sizeof(unsigned int); i++)
+	{
+		hash = (hash ^ words[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+#define EMPTY_HASH 2166136261u
+
+static ClipRect
+func GetPointsBounds(V2 *points, int point_n)
+{
+	float min_x = points[0].x;
+	float max_x = points[0].x;
+	float min_y = points[0].y;
+	float max_y = points[0].y;
+	for(int i = 1; i < point_n; i++)
+	{
+		if(points[i].x < min_x) min_x = points[i].x;
+		if(points[i].x > max_x) max_x = points[i].x;
+		if(points[i].y < min_y) min_y = points[i].y;
+		if(points[i].y > max_y) max_y = points[i].y;
+	}
+
+	ClipRect bounds = {};
+	bounds.min_col = (int)floorf(min_x);
+	bounds.max_col = (int)ceilf(max_x);
+	bounds.min_row = (int)floorf(min_y);
+	bounds.max_row = (int)ceilf(max_y);
+	return bounds;
+}
+
+static void
+func PushQuad3(RenderList *list, Quad3 quad3, unsigned int color, unsigned int cube_face_id)
+{
+	Quad2 quad2 = {};
+	for(int i = 0; i < 4; i++)
+	{
+		quad3.p[i] = list->scale * quad3.p[i];
+		quad2.p[i] = ProjectToScreen(quad3.p[i]);
+	}
+
+	if(IsValidQuad2(quad2))
+	{
+		RenderCommand *command = PushRenderCommand(list);
+		command->kind = RENDER_COMMAND_QUAD;
+		command->color = color;
+		command->cube_face_id = cube_face_id;
+		command->quad = quad3;
+		command->bounds = GetPointsBounds(quad2.p, 4);
+
+		unsigned int hash = HashWords(EMPTY_HASH, &quad3, sizeof(quad3));
+		hash = HashWords(hash, &color, sizeof(color));
+		command->hash = HashWords(hash, &cube_face_id, sizeof(cube_face_id));
+	}
+}
+
+// One command for all the lines, they are binned into tiles together and each tile clips them on its own.
+static void
+func PushLines3(RenderList *list, RenderLine *lines, int line_n, unsigned int color)
+{
+	if(line_n == 0) return;
+
+	if(list->line_n + line_n > list->line_capacity)
+	{
+		int new_capacity = (list->line_capacity > 0) ? 2 * list->line_capacity : 1024;
+		while(new_capacity < list->line_n + line_n) new_capacity *= 2;
+
+		RenderLine *new_lines = new RenderLine[new_capacity];
+		for(int i = 0; i < list->line_n; i++) new_lines[i] = list->lines[i];
+
+		delete[] list->lines;
+		list->lines = new_lines;
+		list->line_capacity = new_capacity;
+	}
+
+	RenderCommand *command = PushRenderCommand(list);
+	command->kind = RENDER_COMMAND_LINES;
+	command->color = color;
+	command->first_line = list->line_n;
+	command->line_n = line_n;
+
+	for(int i = 0; i < line_n; i++)
+	{
+		RenderLine *line = &list->lines[list->line_n + i];
+		line->p1 = list->scale * lines[i].p1;
+		line->p2 = list->scale * lines[i].p2;
+		line->depth_bias = list->scale * lines[i].depth_bias;
+
+		V2 points[2] = {ProjectToScreen(line->p1), ProjectToScreen(line->p2)};
+		ClipRect bounds = GetPointsBounds(points, 2);
+		if(i == 0)
+		{
+			command->bounds = bounds;
+		}
+		else
+		{
+			if(bounds.min_col < command->bounds.min_col) command->bounds.min_col = bounds.min_col;
+			if(bounds.max_col > command->bounds.max_col) command->bounds.max_col = bounds.max_col;
+			if(bounds.min_row < command->bounds.min_row) command->bounds.min_row = bounds.min_row;
+			if(bounds.max_row > command->bounds.max_row) command->bounds.max_row = bounds.max_row;
+		}
+	}
+
+	unsigned int hash = HashWords(EMPTY_HASH, list->lines + list->line_n, line_n * sizeof(RenderLine));
+	command->hash = HashWords(hash, &color, sizeof(color));
+
+	list->line_n += line_n;
+}
+
+// The calling thread takes part in every job, so a pool for N threads starts N - 1 workers.
+struct WorkerPool
+{
+	std::thread *threads;
+	int thread_n;
+
+	std::mutex mutex;
+	std::condition_variable work_ready;
+	std::condition_variable work_done;
+	unsigned int generation;
+	int busy_n;
+	bool quit;
+
+	void (*work)(void *data);
+	void *work_data;
+};
+
+static void
+func WorkerLoop(WorkerPool *pool)
+{
+	unsigned int seen_generation = 0;
+	while(1)
+	{
+		void (*work)(void *data) = 0;
+		void *work_data = 0;
+		{
+			std::unique_lock<std::mutex> lock(pool->mutex);
+			while(!pool->quit && pool->generation == seen_generation)
+			{
+				pool->work_ready.wait(lock);
+			}
+
+			if(pool->quit) break;
+
+			seen_generation = pool->generation;
+			work = pool->work;
+			work_data = pool->work_data;
+		}
+
+		work(work_data);
+
+		{
+			std::lock_guard<std::mutex> lock(pool->mutex);
+			pool->busy_n--;
+			if(pool->busy_n == 0) pool->work_done.notify_one();
+		}
+	}
+}
+
+static void
+func StartWorkerPool(WorkerPool *pool, int thread_n)
+{
+	Assert(thread_n >= 1);
+
+	pool->thread_n = thread_n;
+	pool->threads = new std::thread[thread_n - 1];
+	for(int i = 0; i < thread_n - 1; i++)
+	{
+		pool->threads[i] = std::thread(WorkerLoop, pool);
+	}
+}
+
+static void
+func StopWorkerPool(WorkerPool *pool)
+{
+	{
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		pool->quit = true;
+	}
+	pool->work_ready.notify_all();
+
+	for(int i = 0; i < pool->thread_n - 1; i++)
+	{
+		pool->threads[i].join();
+	}
+
+	delete[] pool->threads;
+	pool->threads = 0;
+	pool->thread_n = 0;
+}
+
+// Runs work on every thread of the pool and returns when all of them are done.
+static void
+func RunOnWorkers(WorkerPool *pool, void (*work)(void *data), void *work_data)
+{
+	if(pool->thread_n > 1)
+	{
+		{
+			std::lock_guard<std::mutex> lock(pool->mutex);
+			pool->work = work;
+			pool->work_data = work_data;
+			pool->busy_n = pool->thread_n - 1;
+			pool->generation++;
+		}
+		pool->work_ready.notify_all();
+	}
+
+	work(work_data);
+
+	if(pool->thread_n > 1)
+	{
+		std::unique_lock<std::mutex> lock(pool->mutex);
+		while(pool->busy_n > 0)
+		{
+			pool->work_done.wait(lock);
+		}
+	}
+}
+
+// Commands are binned into screen tiles in submission order, so the painter's order holds inside every tile
+// and the tiles can be cleared and rasterized independently of each other.
+struct TileRenderer
+{
+	RenderList list;
+
+	int tile_col_n;
+	int tile_row_n;
+	int tile_capacity;
+	int *tile_command_offsets;
+	int *tile_command_ends;
+
+	int *tile_commands;
+	int tile_command_capacity;
+
+	Buffer *buffer;
+	Buffer *base_layer;
+	unsigned int background_color;
+	std::atomic<int> next_tile;
+
+	// Tiles remember what they hold from the last call for the same buffer. Drawing on a layer skips copying
+	// the tiles that nothing was drawn on last time, they still hold the layer. Without a layer, only the part
+	// of a tile that was drawn on last time is cleared, tile_dirty_rects holds everything not background.
+	bool *tile_holds_base_layer;
+	ClipRect *tile_dirty_rects;
+	Buffer *prev_buffer;
+	Buffer *prev_base_layer;
+	unsigned int prev_background_color;
+	int prev_outline_thickness;
+	unsigned int prev_outline_color;
+	int prev_resize_n;
+	bool tiles_are_reset;
+
+	// The hash of the commands drawn into each tile by this call and the last one, and the part of each
+	// tile that held anything but the background before or after this call.
+	unsigned int *tile_hashes;
+	unsigned int *prev_tile_hashes;
+	ClipRect *tile_damage_rects;
+
+	// Where the buffer can differ from what the last call for it left there, see GetDamageRects.
+	ClipRect damage_rects[MAX_DAMAGE_RECT_N];
+	int damage_rect_n;
+
+	// Pixels cleared or copied from the layer by all calls so far.
+	long long cleared_pixel_n;
+
+	// Buffers with a palette are drawn with palette indices, the same ones for a buffer and its layers. The
+	// changed tiles are resolved into colors after the last pass.
+	Palette palette;
+	unsigned int background_color_index;
+	unsigned int outline_color_index;
+
+	WorkerPool pool;
+};
+
+static void
+func InitTileRenderer(TileRenderer *renderer, int thread_n)
+{
+	StartWorkerPool(&renderer->pool, thread_n);
+}
+
+static void
+func FreeTileRenderer(TileRenderer *renderer)
+{
+	StopWorkerPool(&renderer->pool);
+
+	delete[] renderer->list.commands;
+	delete[] renderer->list.lines;
+	delete[] renderer->tile_command_offsets;
+	delete[] renderer->tile_command_ends;
+	delete[] renderer->tile_commands;
+	delete[] renderer->tile_holds_base_layer;
+	delete[] renderer->tile_dirty_rects;
+	delete[] renderer->tile_hashes;
+	delete[] renderer->prev_tile_hashes;
+	delete[] renderer->tile_damage_rects;
+}
+
+static bool
+func GetCommandTileRange(TileRenderer *renderer, RenderCommand *command, ClipRect *tile_range)
+{
+	ClipRect bounds = command->bounds;
+	bool is_visible = (bounds.max_col >= 0 && bounds.min_col < renderer->buffer->width &&
+					   bounds.max_row >= 0 && bounds.min_row < renderer->buffer->height);
+	if(is_visible)
+	{
+		tile_range->min_col = (bounds.min_col > 0) ? (bounds.min_col / TILE_WIDTH) : 0;
+		tile_range->max_col = bounds.max_col / TILE_WIDTH;
+		tile_range->min_row = (bounds.min_row > 0) ? (bounds.min_row / TILE_HEIGHT) : 0;
+		tile_range->max_row = bounds.max_row / TILE_HEIGHT;
+
+		if(tile_range->max_col > renderer->tile_col_n - 1) tile_range->max_col = renderer->tile_col_n - 1;
+		if(tile_range->max_row > renderer->tile_row_n - 1) tile_range->max_row = renderer->tile_row_n - 1;
+	}
+
+	return is_visible;
+}
+
+static void
+func BinRenderCommands(TileRenderer *renderer)
+{
+	PROFILE_SCOPE(PROFILE_BIN);
+
+	Buffer *buffer = renderer->buffer;
+	RenderList *list = &renderer->list;
+
+	renderer->tile_col_n = (buffer->width + TILE_WIDTH - 1) / TILE_WIDTH;
+	renderer->tile_row_n = (buffer->height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+
+	int tile_n = renderer->tile_col_n * renderer->tile_row_n;
+	if(tile_n > renderer->tile_capacity)
+	{
+		delete[] renderer->tile_command_offsets;
+		delete[] renderer->tile_command_ends;
+		delete[] renderer->tile_holds_base_layer;
+		delete[] renderer->tile_dirty_rects;
+		delete[] renderer->tile_hashes;
+		delete[] renderer->prev_tile_hashes;
+		delete[] renderer->tile_damage_rects;
+
+		renderer->tile_capacity = tile_n;
+		renderer->tile_command_offsets = new int[tile_n];
+		renderer->tile_command_ends = new int[tile_n];
+		renderer->tile_holds_base_layer = new bool[tile_n];
+		renderer->tile_dirty_rects = new ClipRect[tile_n];
+		renderer->tile_hashes = new unsigned int[tile_n];
+		renderer->prev_tile_hashes = new unsigned int[tile_n];
+		renderer->tile_damage_rects = new ClipRect[tile_n];
+		renderer->prev_buffer = 0;
+	}
+
+	for(int tile = 0; tile < tile_n; tile++)
+	{
+		renderer->tile_command_ends[tile] = 0;
+	}
+
+	int entry_n = 0;
+	for(int i = 0; i < list->command_n; i++)
+	{
+		ClipRect tile_range = {};
+		if(GetCommandTileRange(renderer, &list->commands[i], &tile_range))
+		{
+			for(int tile_row = tile_range.min_row; tile_row <= tile_range.max_row; tile_row++)
+			{
+				for(int tile_col = tile_range.min_col; tile_col <= tile_range.max_col; tile_col++)
+				{
+					renderer->tile_command_ends[tile_row * renderer->tile_col_n + tile_col]++;
+					entry_n++;
+				}
+			}
+		}
+	}
+
+	if(entry_n > renderer->tile_command_capacity)
+	{
+		delete[] renderer->tile_commands;
+		renderer->tile_command_capacity = 2 * entry_n;
+		renderer->tile_commands = new int[renderer->tile_command_capacity];
+	}
+
+	int offset = 0;
+	for(int tile = 0; tile < tile_n; tile++)
+	{
+		int count = renderer->tile_command_ends[tile];
+		renderer->tile_command_offsets[tile] = offset;
+		renderer->tile_command_ends[tile] = offset;
+		offset += count;
+	}
+
+	for(int i = 0; i < list->command_n; i++)
+	{
+		ClipRect tile_range = {};
+		if(GetCommandTileRange(renderer, &list->commands[i], &tile_range))
+		{
+			for(int tile_row = tile_range.min_row; tile_row <= tile_range.max_row; tile_row++)
+			{
+				for(int tile_col = tile_range.min_col; tile_col <= tile_range.max_col; tile_col++)
+				{
+					int tile = tile_row * renderer->tile_col_n + tile_col;
+					renderer->tile_commands[renderer->tile_command_ends[tile]] = i;
+					renderer->tile_command_ends[tile]++;
+				}
+			}
+		}
+	}
+}
+
+static ClipRect
+func GetTileRect(TileRenderer *renderer, int tile)
+{
+	Buffer *buffer = renderer->buffer;
+
+	int tile_row = tile / renderer->tile_col_n;
+	int tile_col = tile % renderer->tile_col_n;
+
+	ClipRect clip = {};
+	clip.min_col = tile_col * TILE_WIDTH;
+	clip.max_col = clip.min_col + TILE_WIDTH - 1;
+	clip.min_row = tile_row * TILE_HEIGHT;
+	clip.max_row = clip.min_row + TILE_HEIGHT - 1;
+
+	if(clip.max_col > buffer->width - 1) clip.max_col = buffer->width - 1;
+	if(clip.max_row > buffer->height - 1) clip.max_row = buffer->height - 1;
+
+	return clip;
+}
+
+static bool
+func TileHasCommands(TileRenderer *renderer, int tile_row, int tile_col)
+{
+	bool has_commands = false;
+	if(tile_row < renderer->tile_row_n && tile_col < renderer->tile_col_n)
+	{
+		int tile = tile_row * renderer->tile_col_n + tile_col;
+		has_commands = (renderer->tile_command_offsets[tile] != renderer->tile_command_ends[tile]);
+	}
+
+	return has_commands;
+}
+
+static void
+func RenderTile(TileRenderer *renderer, int tile)
+{
+	Buffer *buffer = renderer->buffer;
+	ClipRect clip = GetTileRect(renderer, tile);
+
+	int command_begin = renderer->tile_command_offsets[tile];
+	int command_end = renderer->tile_command_ends[tile];
+
+	PROFILE_SAMPLED_RUN_BEGIN(sampled_run, tile);
+	PROFILE_RUN_SWITCH(sampled_run, PROFILE_SAMPLED_CLEAR);
+	ClipRect dirty_rect = renderer->tile_dirty_rects[tile];
+	bool use_palette = buffer->use_palette;
+	if(!renderer->base_layer)
+	{
+		bool streaming = (command_begin == command_end);
+		unsigned int background_color = use_palette ? renderer->background_color_index : renderer->background_color;
+		if(!IsRectEmpty(dirty_rect)) ClearRect(buffer, dirty_rect, background_color, 0, streaming);
+	}
+	else
+	{
+		if(!renderer->tile_holds_base_layer[tile]) CopyRect(buffer, renderer->base_layer, clip);
+		renderer->tile_holds_base_layer[tile] = (command_begin == command_end);
+	}
+
+	unsigned int hash = EMPTY_HASH;
+	ClipRect drawn_rect = GetEmptyRect();
+	for(int i = command_begin; i < command_end; i++)
+	{
+		RenderCommand *command = &renderer->list.commands[renderer->tile_commands[i]];
+		hash = HashWords(hash, &command->hash, sizeof(command->hash));
+		drawn_rect = UniteRects(drawn_rect, command->bounds);
+
+		unsigned int color = use_palette ? command->color_index : command->color;
+		switch(command->kind)
+		{
+			case RENDER_COMMAND_QUAD:
+			{
+				PROFILE_RUN_SWITCH(sampled_run, PROFILE_SAMPLED_FACES);
+				DrawQuad3(buffer, clip, command->quad, color, command->cube_face_id);
+				break;
+			}
+			case RENDER_COMMAND_LINES:
+			{
+				PROFILE_RUN_SWITCH(sampled_run, PROFILE_SAMPLED_EDGES);
+				RenderLine *lines = renderer->list.lines + command->first_line;
+				for(int line_id = 0; line_id < command->line_n; line_id++)
+				{
+					DrawLine3(buffer, clip, lines[line_id].p1, lines[line_id].p2, color, lines[line_id].depth_bias);
+				}
+				break;
+			}
+			default:
+			{
+				Assert(false);
+			}
+		}
+	}
+
+	drawn_rect = IntersectRects(drawn_rect, clip);
+	renderer->tile_dirty_rects[tile] = drawn_rect;
+	renderer->tile_hashes[tile] = hash;
+	renderer->tile_damage_rects[tile] = renderer->base_layer ? clip : UniteRects(dirty_rect, drawn_rect);
+
+	PROFILE_RUN_END(sampled_run);
+}
+
+static void
+func RenderTilesWork(void *data)
+{
+	TileRenderer *renderer = (TileRenderer *)data;
+
+	{
+		PROFILE_SCOPE(PROFILE_TILE_WORK);
+
+		int tile_n = renderer->tile_col_n * renderer->tile_row_n;
+		while(1)
+		{
+			int tile = renderer->next_tile.fetch_add(1);
+			if(tile >= tile_n) break;
+
+			RenderTile(renderer, tile);
+		}
+	}
+
+	PROFILE_FLUSH_THREAD();
+}
+
+// Runs after every tile is drawn, outlines near the right and upper border of a tile depend on the
+// face ids of the next tiles.
+// A tile that nothing was drawn on holds the background or the base layer with its own outlines. It keeps
+// them, unless something was drawn on the tile to its right or above it, close enough to change its outlines.
+static void
+func OutlineTile(TileRenderer *renderer, int tile)
+{
+	Buffer *buffer = renderer->buffer;
+	int thickness = buffer->outline_thickness;
+	Assert(thickness <= TILE_WIDTH && thickness <= TILE_HEIGHT);
+
+	int tile_row = tile / renderer->tile_col_n;
+	int tile_col = tile % renderer->tile_col_n;
+	bool right_tile_has_commands = TileHasCommands(renderer, tile_row, tile_col + 1);
+	bool upper_tile_has_commands = TileHasCommands(renderer, tile_row + 1, tile_col);
+	if(!right_tile_has_commands && !upper_tile_has_commands && !TileHasCommands(renderer, tile_row, tile_col)) return;
+
+	ClipRect clip = GetTileRect(renderer, tile);
+	DrawOutlines(buffer, clip, buffer->use_palette ? renderer->outline_color_index : buffer->outline_color);
+
+	if(renderer->base_layer)
+	{
+		renderer->tile_holds_base_layer[tile] = false;
+	}
+	else
+	{
+		// Outlines sit up to thickness pixels left of and below a face border, the border can also be
+		// with a face on the next tiles.
+		ClipRect dirty_rect = renderer->tile_dirty_rects[tile];
+		if(!IsRectEmpty(dirty_rect))
+		{
+			dirty_rect.min_col -= thickness;
+			dirty_rect.min_row -= thickness;
+		}
+
+		if(right_tile_has_commands)
+		{
+			ClipRect strip = clip;
+			strip.min_col = clip.max_col - thickness + 1;
+			dirty_rect = UniteRects(dirty_rect, strip);
+		}
+		if(upper_tile_has_commands)
+		{
+			ClipRect strip = clip;
+			strip.min_row = clip.max_row - thickness + 1;
+			dirty_rect = UniteRects(dirty_rect, strip);
+		}
+
+		renderer->tile_dirty_rects[tile] = IntersectRects(dirty_rect, clip);
+		renderer->tile_damage_rects[tile] = UniteRects(renderer->tile_damage_rects[tile],
+													   renderer->tile_dirty_rects[tile]);
+	}
+}
+
+static void
+func OutlineTilesWork(void *data)
+{
+	TileRenderer *renderer = (TileRenderer *)data;
+
+	{
+		PROFILE_SCOPE(PROFILE_EDGES);
+
+		int tile_n = renderer->tile_col_n * renderer->tile_row_n;
+		while(1)
+		{
+			int tile = renderer->next_tile.fetch_add(1);
+			if(tile >= tile_n) break;
+
+			OutlineTile(renderer, tile);
+		}
+	}
+
+	PROFILE_FLUSH_THREAD();
+}
+
+// Runs before the workers start, they only read the palette.
+static void
+func AssignPaletteIndices(TileRenderer *renderer)
+{
+	Palette *palette = &renderer->palette;
+	RenderList *list = &renderer->list;
+	for(int i = 0; i < list->command_n; i++)
+	{
+		list->commands[i].color_index = GetPaletteIndex(palette, list->commands[i].color);
+	}
+
+	renderer->background_color_index = GetPaletteIndex(palette, renderer->background_color);
+	renderer->outline_color_index = GetPaletteIndex(palette, renderer->buffer->outline_color);
+}
+
+// Forgets what the tiles hold if anything changed since the last call, then counts the pixels this call clears.
+static void
+func PrepareTiles(TileRenderer *renderer)
+{
+	Buffer *buffer = renderer->buffer;
+	int tile_n = renderer->tile_col_n * renderer->tile_row_n;
+
+	bool is_same = (renderer->prev_buffer == buffer && renderer->prev_base_layer == renderer->base_layer &&
+					renderer->prev_background_color == renderer->background_color &&
+					renderer->prev_outline_thickness == buffer->outline_thickness &&
+					renderer->prev_outline_color == buffer->outline_color &&
+					renderer->prev_resize_n == buffer->resize_n);
+	renderer->tiles_are_reset = !is_same;
+	if(!is_same)
+	{
+		for(int tile = 0; tile < tile_n; tile++)
+		{
+			renderer->tile_holds_base_layer[tile] = false;
+			renderer->tile_dirty_rects[tile] = GetTileRect(renderer, tile);
+		}
+
+		renderer->prev_buffer = buffer;
+		renderer->prev_base_layer = renderer->base_layer;
+		renderer->prev_background_color = renderer->background_color;
+		renderer->prev_outline_thickness = buffer->outline_thickness;
+		renderer->prev_outline_color = buffer->outline_color;
+		renderer->prev_resize_n = buffer->resize_n;
+	}
+
+	for(int tile = 0; tile < tile_n; tile++)
+	{
+		if(!renderer->base_layer)
+		{
+			renderer->cleared_pixel_n += GetRectPixelN(renderer->tile_dirty_rects[tile]);
+		}
+		else if(!renderer->tile_holds_base_layer[tile])
+		{
+			renderer->cleared_pixel_n += GetRectPixelN(GetTileRect(renderer, tile));
+		}
+	}
+}
+
+// A rect that touches or overlaps one already in the list is merged into it. When the list is full, the rect
+// goes into the one that grows the least from it.
+static int
+func AddDamageRect(ClipRect *rects, int rect_n, int max_rect_n, ClipRect rect)
+{
+	bool is_merged = true;
+	while(is_merged)
+	{
+		is_merged = false;
+		for(int i = 0; i < rect_n; i++)
+		{
+			ClipRect grown = rects[i];
+			grown.min_col--;
+			grown.max_col++;
+			grown.min_row--;
+			grown.max_row++;
+			if(!IsRectEmpty(IntersectRects(grown, rect)))
+			{
+				rect = UniteRects(rects[i], rect);
+				rects[i] = rects[rect_n - 1];
+				rect_n--;
+				is_merged = true;
+				break;
+			}
+		}
+	}
+
+	if(rect_n < max_rect_n)
+	{
+		rects[rect_n] = rect;
+		rect_n++;
+	}
+	else
+	{
+		int best_i = 0;
+		int best_growth = 0;
+		for(int i = 0; i < rect_n; i++)
+		{
+			int growth = GetRectPixelN(UniteRects(rects[i], rect)) - GetRectPixelN(rects[i]);
+			if(i == 0 || growth < best_growth)
+			{
+				best_i = i;
+				best_growth = growth;
+			}
+		}
+
+		rects[best_i] = UniteRects(rects[best_i], rect);
+	}
+
+	return rect_n;
+}
+
+// A tile with the same commands as last time holds the same pixels. With outlines, a tile also changes
+// when the tile to its right or above it does.
+static bool
+func IsTileChanged(int tile_col_n, int tile_row_n, unsigned int *prev_tile_hashes, unsigned int *tile_hashes,
+				   bool has_outlines, int tile)
+{
+	int tile_row = tile / tile_col_n;
+	int tile_col = tile % tile_col_n;
+
+	bool is_changed = (prev_tile_hashes[tile] != tile_hashes[tile]);
+	if(has_outlines && tile_col + 1 < tile_col_n)
+	{
+		is_changed = is_changed || (prev_tile_hashes[tile + 1] != tile_hashes[tile + 1]);
+	}
+	if(has_outlines && tile_row + 1 < tile_row_n)
+	{
+		is_changed = is_changed || (prev_tile_hashes[tile + tile_col_n] != tile_hashes[tile + tile_col_n]);
+	}
+
+	return is_changed;
+}
+
+// The damage of a frame: rects covering every pixel that can differ from the last frame, given the hash
+// of the commands drawn into each tile in both frames and the part of each tile that was not background
+// in either frame, see IsTileChanged. The changed tiles of a row are joined, then merged as in AddDamageRect.
+// Returns the number of rects written, at most max_rect_n.
+static int
+func GetDamageRects(int tile_col_n, int tile_row_n, unsigned int *prev_tile_hashes, unsigned int *tile_hashes,
+					ClipRect *tile_damage_rects, bool has_outlines, ClipRect *rects, int max_rect_n)
+{
+	int rect_n = 0;
+	for(int tile_row = 0; tile_row < tile_row_n; tile_row++)
+	{
+		ClipRect run_rect = GetEmptyRect();
+		for(int tile_col = 0; tile_col <= tile_col_n; tile_col++)
+		{
+			int tile = tile_row * tile_col_n + tile_col;
+			bool is_changed = (tile_col < tile_col_n) &&
+							  IsTileChanged(tile_col_n, tile_row_n, prev_tile_hashes, tile_hashes, has_outlines, tile);
+
+			if(is_changed)
+			{
+				run_rect = UniteRects(run_rect, tile_damage_rects[tile]);
+			}
+			else if(!IsRectEmpty(run_rect))
+			{
+				rect_n = AddDamageRect(rects, rect_n, max_rect_n, run_rect);
+				run_rect = GetEmptyRect();
+			}
+		}
+	}
+
+	return rect_n;
+}
+
+// Resolves the part of every changed tile that was drawn on or cleared, the rest still holds its colors.
+static void
+func ResolveTilesWork(void *data)
+{
+	TileRenderer *renderer = (TileRenderer *)data;
+
+	{
+		PROFILE_SCOPE(PROFILE_RESOLVE);
+
+		Buffer *buffer = renderer->buffer;
+		int tile_n = renderer->tile_col_n * renderer->tile_row_n;
+		while(1)
+		{
+			int tile = renderer->next_tile.fetch_add(1);
+			if(tile >= tile_n) break;
+
+			bool is_changed = renderer->tiles_are_reset ||
+							  IsTileChanged(renderer->tile_col_n, renderer->tile_row_n, renderer->prev_tile_hashes,
+											renderer->tile_hashes, buffer->outline_thickness > 0, tile);
+			if(is_changed) ResolveRect(buffer, renderer->tile_damage_rects[tile], &renderer->palette);
+		}
+	}
+
+	PROFILE_FLUSH_THREAD();
+}
+
+static void
+func RunTilePasses(TileRenderer *renderer)
+{
+	Buffer *buffer = renderer->buffer;
+	if(buffer->use_palette) AssignPaletteIndices(renderer);
+
+	PrepareTiles(renderer);
+
+	renderer->next_tile = 0;
+	RunOnWorkers(&renderer->pool, RenderTilesWork, renderer);
+
+	if(buffer->outline_thickness > 0)
+	{
+		renderer->next_tile = 0;
+		RunOnWorkers(&renderer->pool, OutlineTilesWork, renderer);
+	}
+
+	if(buffer->use_palette)
+	{
+		renderer->next_tile = 0;
+		RunOnWorkers(&renderer->pool, ResolveTilesWork, renderer);
+	}
+
+	if(renderer->tiles_are_reset)
+	{
+		renderer->damage_rects[0] = GetBufferRect(buffer);
+		renderer->damage_rect_n = IsRectEmpty(renderer->damage_rects[0]) ? 0 : 1;
+	}
+	else
+	{
+		renderer->damage_rect_n = GetDamageRects(renderer->tile_col_n, renderer->tile_row_n,
+												 renderer->prev_tile_hashes, renderer->tile_hashes,
+												 renderer->tile_damage_rects, buffer->outline_thickness > 0,
+												 renderer->damage_rects, MAX_DAMAGE_RECT_N);
+	}
+
+	unsigned int *prev_tile_hashes = renderer->prev_tile_hashes;
+	renderer->prev_tile_hashes = renderer->tile_hashes;
+	renderer->tile_hashes = prev_tile_hashes;
+}
+
+// Clears the buffer to the background color and draws the render list into it. Only the pixels drawn on by
+// the last call for the same buffer are cleared again, so nothing else may write to the buffer in between.
+static void
+func RenderTiles(TileRenderer *renderer, Buffer *buffer, unsigned int background_color)
+{
+	renderer->buffer = buffer;
+	renderer->base_layer = 0;
+	renderer->background_color = background_color;
+
+	BinRenderCommands(renderer);
+	RunTilePasses(renderer);
+}
+
+// Copies a previously rendered layer into the buffer and draws the render list on top of it. Tiles that were
+// left untouched by the last call for the same buffer and layer are not copied again, so nothing else may
+// write to the buffer in between.
+static void
+func RenderTilesOnLayer(TileRenderer *renderer, Buffer *buffer, Buffer *base_layer)
+{
+	renderer->buffer = buffer;
+	renderer->base_layer = base_layer;
+
+	BinRenderCommands(renderer);
+	RunTilePasses(renderer);
+}
+
+// Anything written to the buffer outside of the renderer has to be reported, the next call redraws every tile.
+static void
+func ForgetTileContents(TileRenderer *renderer)
+{
+	renderer->prev_buffer = 0;
+}